@@ -0,0 +1,505 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+Implementation of a non-blocking DNS client
+that keeps many queries in flight at once.
+*/
+
+#include "async_dns.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <netinet/in.h>
+
+#define DNS_TYPE_A 1
+#define DNS_TYPE_AAAA 28
+#define DNS_RCODE_NXDOMAIN 3
+#define DNS_CLASS_IN 1
+
+/*
+Returns the current CLOCK_MONOTONIC time in nanoseconds.
+*/
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void put16(unsigned char *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v & 0xff;
+}
+
+static uint16_t get16(const unsigned char *p)
+{
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+/*
+Parses "addr", "addr:port" or "[addr]:port" into a socket address.
+A NULL server selects the first nameserver in /etc/resolv.conf,
+falling back to 127.0.0.1.
+
+Returns 0 on success, -1 if the address could not be parsed.
+*/
+static int parse_server(const char *server, struct sockaddr_storage *ss, socklen_t *len)
+{
+    char host[INET6_ADDRSTRLEN + 8];
+    int port = DNS_PORT;
+
+    if (server == NULL)
+    {
+        FILE *conf = fopen("/etc/resolv.conf", "r");
+        char line[256];
+
+        snprintf(host, sizeof(host), "127.0.0.1");
+        while (conf != NULL && fgets(line, sizeof(line), conf) != NULL)
+        {
+            if (sscanf(line, "nameserver %45s", host) == 1)
+            {
+                break;
+            }
+        }
+        if (conf != NULL)
+        {
+            fclose(conf);
+        }
+    }
+    else if (server[0] == '[')
+    {
+        const char *close = strchr(server, ']');
+        if (close == NULL || close - server - 1 >= (long)sizeof(host))
+        {
+            return -1;
+        }
+        snprintf(host, close - server, "%s", server + 1);
+        if (close[1] == ':')
+        {
+            port = atoi(close + 2);
+        }
+    }
+    else
+    {
+        snprintf(host, sizeof(host), "%s", server);
+        char *colon = strchr(host, ':');
+        if (colon != NULL && strchr(colon + 1, ':') == NULL) // one colon, not a bare IPv6 address
+        {
+            *colon = '\0';
+            port = atoi(colon + 1);
+        }
+    }
+
+    if (port < 1 || port > 65535)
+    {
+        return -1;
+    }
+
+    memset(ss, 0, sizeof(*ss));
+    struct sockaddr_in *in4 = (struct sockaddr_in *)ss;
+    struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)ss;
+
+    if (inet_pton(AF_INET, host, &in4->sin_addr) == 1)
+    {
+        in4->sin_family = AF_INET;
+        in4->sin_port = htons(port);
+        *len = sizeof(*in4);
+        return 0;
+    }
+    if (inet_pton(AF_INET6, host, &in6->sin6_addr) == 1)
+    {
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons(port);
+        *len = sizeof(*in6);
+        return 0;
+    }
+
+    return -1;
+}
+
+/*
+Writes a recursive query for name into q->packet.
+
+Returns 0 on success, -1 if name is not a valid DNS name.
+*/
+static int build_query(dns_query *q, const char *name)
+{
+    unsigned char *p = q->packet;
+    int off = 12;
+
+    put16(p, q->id);
+    put16(p + 2, 0x0100); // standard query, recursion desired
+    put16(p + 4, 1);      // one question
+    put16(p + 6, 0);
+    put16(p + 8, 0);
+    put16(p + 10, 0);
+
+    const char *label = name;
+    while (*label != '\0')
+    {
+        const char *dot = strchr(label, '.');
+        size_t len = dot != NULL ? (size_t)(dot - label) : strlen(label);
+
+        if (len == 0 || len > 63 || off + 1 + len + 5 > DNS_MAX_QUERY)
+        {
+            return -1;
+        }
+
+        p[off++] = len;
+        memcpy(p + off, label, len);
+        off += len;
+
+        label += len;
+        if (*label == '.')
+        {
+            label++; // a trailing dot is allowed
+        }
+    }
+
+    if (off == 12)
+    {
+        return -1; // empty name
+    }
+
+    p[off++] = 0;
+    put16(p + off, q->qtype);
+    put16(p + off + 2, DNS_CLASS_IN);
+    q->len = off + 4;
+
+    return 0;
+}
+
+/*
+Returns the offset just past the (possibly compressed) name
+starting at off, or -1 if it runs past the packet.
+*/
+static int skip_name(const unsigned char *p, int len, int off)
+{
+    while (off < len)
+    {
+        unsigned char l = p[off];
+
+        if (l == 0)
+        {
+            return off + 1;
+        }
+        if ((l & 0xc0) == 0xc0)
+        {
+            return off + 2 <= len ? off + 2 : -1;
+        }
+        if (l & 0xc0)
+        {
+            return -1;
+        }
+        off += l + 1;
+    }
+
+    return -1;
+}
+
+/*
+Looks for the first answer of type qtype in a response, following
+CNAME chains simply by scanning every answer record.
+
+Returns 1 and fills ip if one was found, 0 if the name exists but
+has no such record, -1 if the name does not exist, -2 if the server
+failed or the response is malformed.
+*/
+static int parse_response(const unsigned char *p, int len, uint16_t qtype, char *ip)
+{
+    int rcode = p[3] & 0x0f;
+    int answers = get16(p + 6);
+
+    if (rcode == DNS_RCODE_NXDOMAIN)
+    {
+        return -1;
+    }
+    if (rcode != 0)
+    {
+        return -2; // SERVFAIL, REFUSED, ... say nothing about the name
+    }
+
+    int off = skip_name(p, len, 12);
+    if (off < 0 || off + 4 > len)
+    {
+        return -2;
+    }
+    off += 4; // question type and class
+
+    for (int i = 0; i < answers; i++)
+    {
+        off = skip_name(p, len, off);
+        if (off < 0 || off + 10 > len)
+        {
+            return -2;
+        }
+
+        uint16_t type = get16(p + off);
+        uint16_t rdlen = get16(p + off + 8);
+        off += 10;
+        if (off + rdlen > len)
+        {
+            return -2;
+        }
+
+        if (type == qtype && qtype == DNS_TYPE_A && rdlen == 4)
+        {
+            inet_ntop(AF_INET, p + off, ip, DNS_IP_LENGTH);
+            return 1;
+        }
+        if (type == qtype && qtype == DNS_TYPE_AAAA && rdlen == 16)
+        {
+            inet_ntop(AF_INET6, p + off, ip, DNS_IP_LENGTH);
+            return 1;
+        }
+
+        off += rdlen;
+    }
+
+    return 0;
+}
+
+/*
+Assigns a fresh id to the query in slot index and sends it.
+The low bits of the id select the slot, the high bits change on
+every send so late answers to an earlier send are ignored.
+*/
+static void send_query(dns_client *c, int index)
+{
+    dns_query *q = &c->slots[index];
+
+    c->next_id++;
+    q->id = (uint16_t)(c->next_id * c->num_slots) | index;
+    put16(q->packet, q->id);
+    q->tries++;
+    q->deadline = now_ns() + (uint64_t)DNS_TIMEOUT_MS * 1000000ULL;
+
+    send(c->fd, q->packet, q->len, 0); // a lost packet is handled like a lost answer
+}
+
+/*
+Frees slot index and reports its outcome in out.
+*/
+static void complete(dns_client *c, int index, dns_status status, const char *ip, dns_result *out)
+{
+    dns_query *q = &c->slots[index];
+
+    out->context = q->context;
+    out->tag = q->tag;
+    out->status = status;
+    snprintf(out->ip, sizeof(out->ip), "%s", status == DNS_ANSWERED ? ip : "");
+
+    q->active = false;
+    c->outstanding--;
+}
+
+/*
+Intended to be called once by the thread that uses the client.
+
+Expects three arguments:
+1. Address of dns_client struct
+2. The name server as "addr", "addr:port" or "[addr]:port",
+   NULL for the first nameserver in /etc/resolv.conf
+3. How many queries to keep in flight at most
+
+Returns 0 on success, -1 if the server is invalid or the socket
+could not be created.
+*/
+int init_dns_client(dns_client *c, const char *server, int depth)
+{
+    struct sockaddr_storage ss;
+    socklen_t len;
+
+    if (depth < 1 || depth > DNS_MAX_INFLIGHT || parse_server(server, &ss, &len) != 0)
+    {
+        return -1;
+    }
+
+    c->fd = socket(ss.ss_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (c->fd < 0)
+    {
+        return -1;
+    }
+
+    // a connected socket only receives datagrams from the server
+    if (connect(c->fd, (struct sockaddr *)&ss, len) != 0)
+    {
+        close(c->fd);
+        return -1;
+    }
+
+    c->depth = depth;
+    c->outstanding = 0;
+    c->num_slots = 1;
+    while (c->num_slots < depth)
+    {
+        c->num_slots <<= 1;
+    }
+    c->next_id = (uint16_t)(getpid() ^ now_ns());
+    c->slots = calloc(c->num_slots, sizeof(dns_query));
+    if (c->slots == NULL)
+    {
+        close(c->fd);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+Sends the first query for a hostname.
+
+Expects four arguments:
+1. Address of dns_client struct
+2. The hostname, only needed until dns_submit() returns
+3. Caller data handed back in the dns_result
+4. A caller defined tag handed back in the dns_result
+
+Returns 0 if the query is in flight, -1 if the client already has
+depth queries outstanding or name is not a valid DNS name.
+*/
+int dns_submit(dns_client *c, const char *name, void *context, int tag)
+{
+    if (c->outstanding >= c->depth)
+    {
+        return -1;
+    }
+
+    int index = 0;
+    while (c->slots[index].active)
+    {
+        index++;
+    }
+
+    dns_query *q = &c->slots[index];
+    q->qtype = DNS_TYPE_A;
+    q->tries = 0;
+    if (build_query(q, name) != 0)
+    {
+        return -1;
+    }
+
+    q->active = true;
+    q->context = context;
+    q->tag = tag;
+    c->outstanding++;
+    send_query(c, index);
+
+    return 0;
+}
+
+/*
+Waits up to timeout_ms (-1 for as long as queries are in flight)
+for answers and reports completed lookups.
+
+Queries without an answer after DNS_TIMEOUT_MS are sent again, and
+reported as DNS_NO_REPLY after DNS_MAX_TRIES sends.
+
+Returns the number of results written to out, at most max.
+*/
+int dns_poll(dns_client *c, int timeout_ms, dns_result *out, int max)
+{
+    int done = 0;
+    uint64_t now = now_ns();
+    uint64_t next = UINT64_MAX;
+
+    for (int i = 0; i < c->num_slots && done < max; i++)
+    {
+        dns_query *q = &c->slots[i];
+        if (!q->active)
+        {
+            continue;
+        }
+
+        if (q->deadline <= now)
+        {
+            if (q->tries >= DNS_MAX_TRIES)
+            {
+                complete(c, i, DNS_NO_REPLY, NULL, &out[done++]);
+                continue;
+            }
+            send_query(c, i);
+        }
+
+        if (q->deadline < next)
+        {
+            next = q->deadline;
+        }
+    }
+
+    if (done == 0 && c->outstanding > 0)
+    {
+        int wait = (int)((next - now) / 1000000ULL) + 1;
+        if (timeout_ms >= 0 && timeout_ms < wait)
+        {
+            wait = timeout_ms;
+        }
+
+        struct pollfd pfd = {.fd = c->fd, .events = POLLIN};
+        poll(&pfd, 1, wait);
+    }
+
+    unsigned char buf[DNS_MAX_PACKET];
+    while (done < max)
+    {
+        ssize_t n = recv(c->fd, buf, sizeof(buf), 0);
+        if (n < 0)
+        {
+            if (errno == ECONNREFUSED || errno == EINTR)
+            {
+                continue; // nothing listening yet, the timeout resends
+            }
+            break;
+        }
+        if (n < 12 || !(buf[2] & 0x80)) // too short, or not a response
+        {
+            continue;
+        }
+
+        uint16_t id = get16(buf);
+        int index = id & (c->num_slots - 1);
+        dns_query *q = &c->slots[index];
+        if (!q->active || q->id != id || n < q->len || memcmp(buf + 12, q->packet + 12, q->len - 12) != 0)
+        {
+            continue; // late, spoofed or for another question
+        }
+
+        char ip[DNS_IP_LENGTH];
+        int found = parse_response(buf, n, q->qtype, ip);
+
+        if (found == 0 && q->qtype == DNS_TYPE_A)
+        {
+            q->qtype = DNS_TYPE_AAAA;
+            q->tries = 0;
+            put16(q->packet + q->len - 4, DNS_TYPE_AAAA); // the question ends with type and class
+            send_query(c, index);
+            continue;
+        }
+
+        complete(c, index, found == 1 ? DNS_ANSWERED : found == -2 ? DNS_NO_REPLY : DNS_NO_ADDRESS, ip, &out[done++]);
+    }
+
+    return done;
+}
+
+/*
+Used to close the socket and free the slots.
+Queries still in flight are abandoned.
+
+Returns 0 on success.
+*/
+int de_init_dns_client(dns_client *c)
+{
+    close(c->fd);
+    free(c->slots);
+
+    return 0;
+}
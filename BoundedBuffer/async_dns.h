@@ -0,0 +1,91 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+A header file used to implement a non-blocking DNS
+client that keeps many queries in flight at once.
+*/
+
+#ifndef ASYNC_DNS_H
+#define ASYNC_DNS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#define DNS_PORT 53
+#define DNS_TIMEOUT_MS 1000   // before a query is sent again
+#define DNS_MAX_TRIES 3       // sends per query before it is reported as failed
+#define DNS_MAX_PACKET 1232   // largest response accepted (EDNS safe UDP size)
+#define DNS_MAX_QUERY 272     // header + encoded name + type and class
+#define DNS_MAX_INFLIGHT 4096
+#define DNS_IP_LENGTH INET6_ADDRSTRLEN
+
+/*
+Declare a struct of type dns_query that tracks one outstanding
+lookup. The query packet is kept so it can be sent again after
+a timeout.
+
+A name is first asked for its A record. If the server answers
+without one, the query is sent again for AAAA, matching the first
+address getaddrinfo() would return for an IPv6 only host.
+*/
+typedef struct
+{
+    bool active;
+    void *context;     // caller data returned with the result
+    int tag;
+    uint16_t id;
+    uint16_t qtype;
+    uint64_t deadline; // CLOCK_MONOTONIC ns at which the query is sent again
+    int tries;
+    int len;
+    unsigned char packet[DNS_MAX_QUERY];
+} dns_query;
+
+/*
+The outcome of a lookup. Only DNS_ANSWERED and DNS_NO_ADDRESS are
+answers about the name, worth caching.
+*/
+typedef enum
+{
+    DNS_ANSWERED,   // ip holds the address
+    DNS_NO_ADDRESS, // NXDOMAIN, or the name has neither an A nor an AAAA record
+    DNS_NO_REPLY    // no reply after DNS_MAX_TRIES sends, or the server failed
+} dns_status;
+
+/*
+Declare a struct of type dns_result, filled by dns_poll() for
+each completed lookup.
+*/
+typedef struct
+{
+    void *context;
+    int tag;
+    dns_status status;
+    char ip[DNS_IP_LENGTH];
+} dns_result;
+
+/*
+Declare a struct of type dns_client, one per thread. All queries
+share a single UDP socket connected to the name server, and the
+low bits of a query id select its slot.
+*/
+typedef struct
+{
+    int fd;
+    int depth;         // most queries kept in flight
+    int outstanding;
+    int num_slots;     // power of two >= depth
+    uint16_t next_id;
+    dns_query *slots;
+} dns_client;
+
+int init_dns_client(dns_client *c, const char *server, int depth);
+int dns_submit(dns_client *c, const char *name, void *context, int tag);
+int dns_poll(dns_client *c, int timeout_ms, dns_result *out, int max);
+int de_init_dns_client(dns_client *c);
+
+#endif
@@ -0,0 +1,369 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+Implementation of lookups with a deadline, retries
+with backoff and hedged attempts.
+*/
+
+#include "attempt.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#define NO_DEADLINE UINT64_MAX
+#define WAIT_FOREVER -1
+
+/*
+Drops one reference to a job, freeing it with the last.
+*/
+static void put_job(attempt_job *job)
+{
+    if (__atomic_sub_fetch(&job->refs, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        pthread_mutex_destroy(&job->lock);
+        pthread_cond_destroy(&job->done);
+        free(job);
+    }
+}
+
+/*
+Counts the latency of one attempt, and every HEDGE_REFRESH attempts
+moves the hedging delay to the current 95th percentile.
+*/
+static void record_attempt(attempt_pool *p, uint64_t ns)
+{
+    pthread_mutex_lock(&p->stats_lock);
+    histogram_add(&p->latencies, ns);
+    if (p->latencies.count == HEDGE_MIN_SAMPLES || p->latencies.count % HEDGE_REFRESH == 0)
+    {
+        __atomic_store_n(&p->hedge_after, histogram_percentile(&p->latencies, 0.95), __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&p->stats_lock);
+}
+
+/*
+Worker thread of an attempt_pool. Makes each attempt it takes from
+the jobs fifo, unless the job was finished while it waited there.
+*/
+static void *run_attempts(void *arg)
+{
+    attempt_pool *p = arg;
+    void *item;
+
+    while (de_q(&p->jobs, &item) != FIFO_CLOSED)
+    {
+        attempt_job *job = item;
+        char ip[INET6_ADDRSTRLEN];
+        int result = RESOLVER_AGAIN;
+
+        if (!__atomic_load_n(&job->finished, __ATOMIC_ACQUIRE))
+        {
+            uint64_t started = metrics_now();
+            result = resolver_lookup(p->backend, job->name, ip, sizeof(ip));
+            record_attempt(p, metrics_now() - started);
+        }
+
+        pthread_mutex_lock(&job->lock);
+        job->outstanding--;
+        if (!job->finished && result != RESOLVER_AGAIN)
+        {
+            job->result = result;
+            if (result == RESOLVER_SUCCESS)
+            {
+                strcpy(job->ip, ip);
+            }
+            __atomic_store_n(&job->finished, true, __ATOMIC_RELEASE);
+        }
+        pthread_cond_signal(&job->done);
+        pthread_mutex_unlock(&job->lock);
+
+        put_job(job);
+    }
+
+    return NULL;
+}
+
+/*
+Queues one more attempt of a job, waiting for room in the jobs fifo
+until the monotonic clock reaches deadline at the latest. Called with
+the job's lock held, which is dropped while the fifo may block.
+
+Returns true if the attempt was queued, false if the fifo stayed
+full until the deadline.
+*/
+static bool submit(attempt_pool *p, attempt_job *job, uint64_t deadline)
+{
+    int wait_ms = WAIT_FOREVER;
+    if (deadline != NO_DEADLINE)
+    {
+        uint64_t now = metrics_now();
+        wait_ms = now < deadline ? (int)((deadline - now + 999999) / 1000000) : 0;
+    }
+
+    job->outstanding++;
+    __atomic_add_fetch(&job->refs, 1, __ATOMIC_RELAXED);
+
+    pthread_mutex_unlock(&job->lock);
+    int queued = timed_en_q(&p->jobs, job, wait_ms);
+    pthread_mutex_lock(&job->lock);
+
+    if (queued != 0)
+    {
+        job->outstanding--;
+        __atomic_sub_fetch(&job->refs, 1, __ATOMIC_RELAXED); // the caller still holds its own
+        return false;
+    }
+
+    return true;
+}
+
+/*
+Waits on the job until it is signalled or the monotonic clock
+reaches until. Called with the job's lock held.
+*/
+static void wait_until(attempt_job *job, uint64_t until)
+{
+    if (until == NO_DEADLINE)
+    {
+        pthread_cond_wait(&job->done, &job->lock);
+        return;
+    }
+
+    struct timespec ts = {.tv_sec = until / 1000000000ULL, .tv_nsec = until % 1000000000ULL};
+    pthread_cond_timedwait(&job->done, &job->lock, &ts);
+}
+
+/*
+Returns how long to wait before retry number retry (from 1): a
+random point in the upper half of an exponentially growing window.
+*/
+static uint64_t backoff(int retry)
+{
+    static __thread unsigned int seed;
+
+    if (seed == 0)
+    {
+        seed = (unsigned int)(uintptr_t)&seed ^ (unsigned int)metrics_now();
+    }
+
+    int shift = retry - 1 < 16 ? retry - 1 : 16;
+    uint64_t window = (uint64_t)BACKOFF_BASE_MS << shift;
+    if (window > BACKOFF_MAX_MS)
+    {
+        window = BACKOFF_MAX_MS;
+    }
+    window *= 1000000ULL;
+
+    return window / 2 + (uint64_t)rand_r(&seed) % (window / 2 + 1);
+}
+
+/*
+Expects six arguments:
+1. a pointer to an attempt_pool struct
+2. the resolver backend attempts go to
+3. the number of worker threads, which must exceed the number of
+   threads calling attempt_lookup() for slow attempts to be given up on
+4. the deadline of a lookup in milliseconds, 0 for none
+5. how often an attempt failing with RESOLVER_AGAIN is retried
+6. whether to hedge slow attempts with a second one
+
+Returns 0 on success, -1 on failure
+*/
+int init_attempts(attempt_pool *p, resolver *backend, int num_workers, int deadline_ms, int retries, bool hedge)
+{
+    p->backend = backend;
+    p->deadline = (uint64_t)deadline_ms * 1000000ULL;
+    p->retries = retries;
+    p->hedge = hedge;
+    p->hedge_after = 0;
+    p->hedged = 0;
+    memset(&p->latencies, 0, sizeof(p->latencies));
+
+    // a lookup has at most two attempts queued, leave room for abandoned ones too
+    if (init_q(&p->jobs, 4 * num_workers, FIFO_LOCK_FREE) != 0)
+    {
+        return -1;
+    }
+
+    p->workers = malloc(num_workers * sizeof(pthread_t));
+    if (p->workers == NULL)
+    {
+        de_init_q(&p->jobs);
+        return -1;
+    }
+
+    pthread_mutex_init(&p->stats_lock, NULL);
+    for (p->num_workers = 0; p->num_workers < num_workers; p->num_workers++)
+    {
+        if (pthread_create(&p->workers[p->num_workers], NULL, &run_attempts, p) != 0)
+        {
+            de_init_attempts(p);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+Expects four arguments:
+1. a pointer to an attempt_pool struct
+2. the hostname to resolve
+3. where the address is written on success
+4. the size of ip
+
+Makes an attempt through the pool and waits for it until the
+deadline. An attempt failing with RESOLVER_AGAIN is retried after a
+jittered exponential backoff, and with hedging a second attempt is
+started once the first has taken longer than most attempts do.
+
+Returns RESOLVER_SUCCESS, RESOLVER_FAILURE, ATTEMPT_TIMEOUT,
+ATTEMPT_RETRY_LIMIT or ATTEMPT_NO_MEMORY. A lookup whose attempt
+could not be queued before the deadline times out as well.
+*/
+int attempt_lookup(attempt_pool *p, const char *name, char *ip, int size)
+{
+    uint64_t deadline = p->deadline > 0 ? metrics_now() + p->deadline : NO_DEADLINE;
+    int tries = 0;
+    int result;
+
+    attempt_job *job = calloc(1, sizeof(attempt_job));
+    if (job == NULL)
+    {
+        return ATTEMPT_NO_MEMORY;
+    }
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&job->done, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&job->lock, NULL);
+    job->refs = 1;
+    strncpy(job->name, name, ATTEMPT_NAME_LENGTH - 1);
+
+    pthread_mutex_lock(&job->lock);
+    for (;;)
+    {
+        if (job->outstanding == 0) // nothing in flight: first try, or every attempt asked to try again
+        {
+            if (tries > p->retries)
+            {
+                result = ATTEMPT_RETRY_LIMIT;
+                break;
+            }
+            if (tries > 0)
+            {
+                uint64_t retry_at = metrics_now() + backoff(tries);
+                if (retry_at >= deadline)
+                {
+                    wait_until(job, deadline);
+                    result = ATTEMPT_TIMEOUT;
+                    break;
+                }
+                while (metrics_now() < retry_at)
+                {
+                    wait_until(job, retry_at);
+                }
+            }
+
+            if (!submit(p, job, deadline))
+            {
+                result = ATTEMPT_TIMEOUT;
+                break;
+            }
+            tries++;
+
+            uint64_t hedge_after = __atomic_load_n(&p->hedge_after, __ATOMIC_RELAXED);
+            uint64_t hedge_at = p->hedge && hedge_after > 0 ? metrics_now() + hedge_after : NO_DEADLINE;
+
+            while (!job->finished && job->outstanding > 0)
+            {
+                uint64_t until = hedge_at < deadline ? hedge_at : deadline;
+                wait_until(job, until);
+
+                uint64_t now = metrics_now();
+                if (now >= deadline)
+                {
+                    break;
+                }
+                if (now >= hedge_at && !job->finished && job->outstanding > 0)
+                {
+                    if (submit(p, job, deadline))
+                    {
+                        __atomic_add_fetch(&p->hedged, 1, __ATOMIC_RELAXED);
+                    }
+                    hedge_at = NO_DEADLINE;
+                }
+            }
+        }
+
+        if (job->finished)
+        {
+            result = job->result;
+            if (result == RESOLVER_SUCCESS)
+            {
+                strncpy(ip, job->ip, size - 1);
+                ip[size - 1] = '\0';
+            }
+            break;
+        }
+        if (metrics_now() >= deadline)
+        {
+            result = ATTEMPT_TIMEOUT;
+            break;
+        }
+    }
+
+    // attempts still queued or running are skipped or discarded
+    __atomic_store_n(&job->finished, true, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&job->lock);
+    put_job(job);
+
+    return result;
+}
+
+/*
+Returns the reason code written to the resolver log for a failed
+lookup, or NULL if the result needs none.
+*/
+const char *attempt_reason(int result)
+{
+    switch (result)
+    {
+    case ATTEMPT_TIMEOUT:
+        return "TIMEOUT";
+    case ATTEMPT_RETRY_LIMIT:
+        return "RETRY_LIMIT";
+    case ATTEMPT_NO_MEMORY:
+        return "NO_MEMORY";
+    default:
+        return NULL;
+    }
+}
+
+/*
+Expects as sole argument a pointer to an attempt_pool struct
+
+Must only be called once no thread is in attempt_lookup(). Waits for
+attempts still running, which nobody waits for anymore.
+
+Returns 0 on success
+*/
+int de_init_attempts(attempt_pool *p)
+{
+    close_q(&p->jobs);
+    for (int i = 0; i < p->num_workers; i++)
+    {
+        pthread_join(p->workers[i], NULL);
+    }
+
+    free(p->workers);
+    de_init_q(&p->jobs);
+    pthread_mutex_destroy(&p->stats_lock);
+
+    return 0;
+}
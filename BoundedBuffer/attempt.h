@@ -0,0 +1,84 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+A header file used to implement lookups with a deadline,
+retries with backoff and hedged attempts.
+*/
+
+#ifndef ATTEMPT_H
+#define ATTEMPT_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <arpa/inet.h>
+#include "shared_array.h"
+#include "resolver.h"
+#include "metrics.h"
+
+/*
+Returned by attempt_lookup() besides the RESOLVER_ codes
+*/
+#define ATTEMPT_TIMEOUT -3     // the deadline passed before any attempt finished
+#define ATTEMPT_RETRY_LIMIT -4 // every attempt failed with RESOLVER_AGAIN
+#define ATTEMPT_NO_MEMORY -5   // the lookup could not be set up
+
+#define ATTEMPT_NAME_LENGTH 256
+#define BACKOFF_BASE_MS 10     // wait before the first retry, doubled for every further one
+#define BACKOFF_MAX_MS 1000
+#define HEDGE_MIN_SAMPLES 20   // attempts timed before hedging starts
+#define HEDGE_REFRESH 64       // attempts between updates of the hedging delay
+
+/*
+Declare a struct of type attempt_job, one lookup and the attempts
+made for it. Shared by the thread waiting for it and every worker
+holding one of its attempts, the last of which frees it.
+*/
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t done;  // signalled by workers as attempts finish
+    int refs;
+    int outstanding;      // attempts queued or running
+    bool finished;        // result is final, remaining attempts are skipped
+    int result;
+    char ip[INET6_ADDRSTRLEN];
+    char name[ATTEMPT_NAME_LENGTH];
+} attempt_job;
+
+/*
+Declare a struct of type attempt_pool.
+
+Workers take attempts from the jobs fifo and make them through the
+resolver backend, so the thread waiting for a lookup can give up at
+its deadline and start another attempt while a slow one still runs.
+A worker stays busy until its attempt returns, even when nobody
+waits for it anymore.
+
+The latency of every attempt goes into latencies. With hedging on,
+a lookup whose attempt has taken longer than the 95th percentile of
+those gets a second attempt, and the first answer wins.
+*/
+typedef struct
+{
+    resolver *backend;
+    fifo jobs;
+    pthread_t *workers;
+    int num_workers;
+    uint64_t deadline;    // ns, 0 for none
+    int retries;
+    bool hedge;
+    uint64_t hedge_after; // ns, 0 until HEDGE_MIN_SAMPLES attempts were timed
+    uint64_t hedged;      // second attempts started
+    pthread_mutex_t stats_lock;
+    histogram latencies;
+} attempt_pool;
+
+int init_attempts(attempt_pool *p, resolver *backend, int num_workers, int deadline_ms, int retries, bool hedge);
+int attempt_lookup(attempt_pool *p, const char *name, char *ip, int size);
+const char *attempt_reason(int result);
+int de_init_attempts(attempt_pool *p);
+
+#endif
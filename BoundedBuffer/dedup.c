@@ -0,0 +1,250 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+Implementation of the filters that recognize
+hostnames a requester has seen before.
+*/
+
+#include "dedup.h"
+#include "res_cache.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+Scrambles the bits of a hash, so the Bloom filter's block and bit
+positions do not depend on each other.
+*/
+static uint64_t mix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+
+    return x;
+}
+
+/*
+Doubles the number of buckets of shard s once it holds more than
+two entries per bucket. The caller must hold the shard lock.
+*/
+static void grow(dedup_shard *s)
+{
+    size_t old_count = s->num_buckets;
+    dedup_entry **old = s->buckets;
+    dedup_entry **buckets = calloc(old_count * 2, sizeof(dedup_entry *));
+
+    if (buckets == NULL)
+    {
+        return; // keep the longer chains
+    }
+
+    s->buckets = buckets;
+    s->num_buckets = old_count * 2;
+
+    for (size_t i = 0; i < old_count; i++)
+    {
+        dedup_entry *e = old[i];
+        while (e != NULL)
+        {
+            dedup_entry *next = e->next;
+            size_t b = (e->hash / DEDUP_SHARDS) & (s->num_buckets - 1);
+            e->next = s->buckets[b];
+            s->buckets[b] = e;
+            e = next;
+        }
+    }
+
+    free(old);
+}
+
+/*
+Expects four arguments:
+1. a pointer to a dedup_filter struct
+2. DEDUP_EXACT or DEDUP_BLOOM
+3. whether duplicates are dropped or only counted
+4. DEDUP_BLOOM: the size of the input in bytes. The filter gets one
+   byte per input byte, rounded up to a power of two blocks, which
+   for typical hostnames is enough to keep false positives well
+   below one in a thousand.
+
+Returns 0 on success, -1 if memory could not be allocated
+*/
+int init_dedup(dedup_filter *d, dedup_kind kind, bool drop, size_t bytes)
+{
+    d->kind = kind;
+    d->drop = drop;
+    d->duplicates = 0;
+    d->blocks = NULL;
+    d->shards = NULL;
+
+    if (kind == DEDUP_BLOOM)
+    {
+        size_t block_bytes = BLOOM_BLOCK_WORDS * sizeof(uint64_t);
+
+        d->num_blocks = 1;
+        while (d->num_blocks * block_bytes < bytes)
+        {
+            d->num_blocks *= 2;
+        }
+
+        if (posix_memalign((void **)&d->blocks, block_bytes, d->num_blocks * block_bytes) != 0)
+        {
+            d->blocks = NULL;
+            return -1;
+        }
+        memset(d->blocks, 0, d->num_blocks * block_bytes);
+
+        return 0;
+    }
+
+    d->shards = calloc(DEDUP_SHARDS, sizeof(dedup_shard));
+    if (d->shards == NULL)
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < DEDUP_SHARDS; i++)
+    {
+        dedup_shard *s = &d->shards[i];
+        s->buckets = calloc(DEDUP_INITIAL_BUCKETS, sizeof(dedup_entry *));
+        if (s->buckets == NULL)
+        {
+            return -1;
+        }
+        s->num_buckets = DEDUP_INITIAL_BUCKETS;
+        s->count = 0;
+        pthread_mutex_init(&s->lock, NULL);
+    }
+
+    return 0;
+}
+
+/*
+Sets the bits of a hash in the Bloom filter.
+
+Returns true if they were all set already.
+*/
+static bool bloom_add(dedup_filter *d, uint64_t hash)
+{
+    uint64_t h = mix(hash);
+    uint64_t *block = d->blocks + (hash & (d->num_blocks - 1)) * BLOOM_BLOCK_WORDS;
+    uint32_t bit = h;
+    uint32_t step = (h >> 32) | 1; // odd, so the bits differ
+    bool seen = true;
+
+    for (int i = 0; i < BLOOM_HASHES; i++)
+    {
+        uint32_t pos = (bit + i * step) % (BLOOM_BLOCK_WORDS * 64);
+        uint64_t mask = 1ULL << (pos % 64);
+
+        if ((__atomic_load_n(&block[pos / 64], __ATOMIC_RELAXED) & mask) == 0)
+        {
+            __atomic_fetch_or(&block[pos / 64], mask, __ATOMIC_RELAXED);
+            seen = false;
+        }
+    }
+
+    return seen;
+}
+
+/*
+Adds a hostname to the exact set.
+
+Returns true if it was there already.
+*/
+static bool set_add(dedup_filter *d, uint64_t hash, const char *name, int len)
+{
+    dedup_shard *s = &d->shards[hash & (DEDUP_SHARDS - 1)];
+    size_t b;
+
+    pthread_mutex_lock(&s->lock);
+
+    b = (hash / DEDUP_SHARDS) & (s->num_buckets - 1);
+    for (dedup_entry *e = s->buckets[b]; e != NULL; e = e->next)
+    {
+        if (e->hash == hash && e->len == len && memcmp(e->name, name, len) == 0)
+        {
+            pthread_mutex_unlock(&s->lock);
+            return true;
+        }
+    }
+
+    dedup_entry *e = malloc(sizeof(dedup_entry) + len);
+    if (e != NULL) // otherwise the name is passed on, and may be again
+    {
+        e->hash = hash;
+        e->len = len;
+        memcpy(e->name, name, len);
+        e->next = s->buckets[b];
+        s->buckets[b] = e;
+
+        if (++s->count > 2 * s->num_buckets)
+        {
+            grow(s);
+        }
+    }
+
+    pthread_mutex_unlock(&s->lock);
+    return false;
+}
+
+/*
+Expects three arguments:
+1. a pointer to a dedup_filter struct
+2. a hostname, not necessarily NUL terminated
+3. its length
+
+Remembers the hostname, and counts it if it was seen before.
+
+Returns true if the hostname is a duplicate the caller should drop.
+*/
+bool dedup_seen(dedup_filter *d, const char *name, int len)
+{
+    uint64_t hash = hash_name_n(name, len);
+    bool seen = d->kind == DEDUP_BLOOM ? bloom_add(d, hash) : set_add(d, hash, name, len);
+
+    if (!seen)
+    {
+        return false;
+    }
+
+    __atomic_add_fetch(&d->duplicates, 1, __ATOMIC_RELAXED);
+    return d->drop;
+}
+
+/*
+Expects as sole argument a pointer to a dedup_filter struct
+
+Returns 0 on success
+*/
+int de_init_dedup(dedup_filter *d)
+{
+    free(d->blocks);
+
+    if (d->shards != NULL)
+    {
+        for (int i = 0; i < DEDUP_SHARDS; i++)
+        {
+            dedup_shard *s = &d->shards[i];
+            for (size_t b = 0; b < s->num_buckets; b++)
+            {
+                dedup_entry *e = s->buckets != NULL ? s->buckets[b] : NULL;
+                while (e != NULL)
+                {
+                    dedup_entry *next = e->next;
+                    free(e);
+                    e = next;
+                }
+            }
+            free(s->buckets);
+            pthread_mutex_destroy(&s->lock);
+        }
+        free(d->shards);
+    }
+
+    return 0;
+}
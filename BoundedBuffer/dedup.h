@@ -0,0 +1,78 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+A header file used to implement the filters that
+recognize hostnames a requester has seen before.
+*/
+
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define DEDUP_SHARDS 64           // independently locked parts of the exact set, a power of two
+#define DEDUP_INITIAL_BUCKETS 256 // per shard, doubled as the shard fills
+#define BLOOM_BLOCK_WORDS 8       // a block is one cache line of 512 bits
+#define BLOOM_HASHES 8            // bits set per hostname, all in the same block
+
+typedef enum
+{
+    DEDUP_EXACT, // remembers every hostname, never mistakes a new one for a duplicate
+    DEDUP_BLOOM  // fixed size, mistakes a small fraction of new hostnames for duplicates
+} dedup_kind;
+
+/*
+Declare a struct of type dedup_entry, a hostname in the exact set.
+Entries of a bucket are chained through next.
+*/
+typedef struct dedup_entry
+{
+    struct dedup_entry *next;
+    uint64_t hash;
+    int len;
+    char name[];
+} dedup_entry;
+
+/*
+Declare a struct of type dedup_shard, a chained hash set guarded by
+its own mutex.
+*/
+typedef struct
+{
+    pthread_mutex_t lock;
+    dedup_entry **buckets;
+    size_t num_buckets, count;
+} dedup_shard;
+
+/*
+Declare a struct of type dedup_filter.
+
+DEDUP_EXACT spreads hostnames over DEDUP_SHARDS shards by hash, as
+the result cache does. DEDUP_BLOOM is a blocked Bloom filter: a
+hostname's hash picks one cache line sized block and BLOOM_HASHES
+bits within it, which are set with atomic fetch-or and no lock, so
+a test costs a single cache miss.
+
+Two requesters adding the same new hostname at once may both find
+it new. Only repeats are ever counted as duplicates.
+*/
+typedef struct
+{
+    dedup_kind kind;
+    bool drop;            // drop duplicates, otherwise only count them
+    uint64_t *blocks;     // DEDUP_BLOOM: num_blocks * BLOOM_BLOCK_WORDS words
+    uint64_t num_blocks;  // a power of two
+    dedup_shard *shards;  // DEDUP_EXACT
+    uint64_t duplicates;
+} dedup_filter;
+
+int init_dedup(dedup_filter *d, dedup_kind kind, bool drop, size_t bytes);
+bool dedup_seen(dedup_filter *d, const char *name, int len);
+int de_init_dedup(dedup_filter *d);
+
+#endif
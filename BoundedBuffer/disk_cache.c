@@ -0,0 +1,354 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+Implementation of a resolution cache kept in a
+memory mapped file across runs.
+*/
+
+#include "disk_cache.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SLOT_WORDS (sizeof(disk_slot) / sizeof(uint64_t))
+
+/*
+Returns the checksum of a slot, an FNV-1a hash of everything after
+the checksum field.
+*/
+static uint64_t slot_checksum(const disk_slot *s)
+{
+    const unsigned char *p = (const unsigned char *)&s->hash;
+    const unsigned char *end = (const unsigned char *)(s + 1);
+    uint64_t h = 14695981039346656037ULL;
+
+    while (p < end)
+    {
+        h ^= *p++;
+        h *= 1099511628211ULL;
+    }
+
+    return h;
+}
+
+/*
+Copies a slot word by word with relaxed atomic loads, as a writer
+may change it meanwhile. The sequence lock tells whether it did.
+*/
+static void load_slot(const disk_slot *s, disk_slot *out)
+{
+    const uint64_t *from = (const uint64_t *)s;
+    uint64_t *to = (uint64_t *)out;
+
+    for (size_t i = 0; i < SLOT_WORDS; i++)
+    {
+        to[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+    }
+}
+
+/*
+Copies everything but the sequence lock into a slot the caller has
+locked.
+*/
+static void store_slot(disk_slot *s, const disk_slot *in)
+{
+    uint64_t *to = (uint64_t *)s;
+    const uint64_t *from = (const uint64_t *)in;
+
+    for (size_t i = 1; i < SLOT_WORDS; i++)
+    {
+        __atomic_store_n(&to[i], from[i], __ATOMIC_RELAXED);
+    }
+}
+
+/*
+Whether a sequence value belongs to a write in progress in this run,
+rather than to a finished write or one a crashed run left behind.
+*/
+static bool writing(disk_cache *d, uint64_t seq)
+{
+    return (seq & 1) && (uint32_t)(seq >> 32) == d->run;
+}
+
+/*
+Takes a consistent copy of slot i.
+
+Returns true if out holds a valid entry, false if the slot is empty,
+torn or busy.
+*/
+static bool read_slot(disk_cache *d, uint64_t i, disk_slot *out)
+{
+    disk_slot *s = &d->slots[i];
+
+    for (int tries = 0; tries < 4; tries++)
+    {
+        uint64_t before = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+        if (before & 1)
+        {
+            if (!writing(d, before))
+            {
+                return false; // abandoned by a crashed run
+            }
+            continue;
+        }
+
+        load_slot(s, out);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == before)
+        {
+            return out->state != SLOT_EMPTY && out->checksum == slot_checksum(out) && out->name_len < sizeof(out->name);
+        }
+    }
+
+    return false;
+}
+
+/*
+Sets up a new cache file of num_slots slots. The file is sized with
+ftruncate(), so slots take no disk space until first written.
+
+Returns 0 on success, -1 with errno set on failure
+*/
+static int format_file(int fd, size_t num_slots)
+{
+    disk_header h = {.magic = DISK_CACHE_MAGIC, .version = DISK_CACHE_VERSION, .slot_size = sizeof(disk_slot), .num_slots = num_slots, .runs = 0};
+
+    if (ftruncate(fd, DISK_CACHE_HEADER + num_slots * sizeof(disk_slot)) != 0)
+    {
+        return -1;
+    }
+
+    // the header goes last, a file without one is formatted again next time
+    if (pwrite(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) || fsync(fd) != 0)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+Expects four arguments:
+1. a pointer to a disk_cache struct
+2. the path of the cache file, created if it does not exist
+3. the number of slots of a new file, a power of two. An existing
+   file keeps the number it was created with.
+4. how long, in seconds, results stored by this run stay valid
+
+Opening takes the same time whatever the file holds: it is mapped
+and only its header is read. Several processes may share a file.
+
+Returns 0 on success, -1 with errno set on failure, EINVAL if the
+file is not a cache file
+*/
+int init_disk_cache(disk_cache *d, const char *path, size_t num_slots, int ttl_seconds)
+{
+    struct stat st;
+    disk_header h;
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    // keep a concurrent run from formatting the file at the same time
+    flock(fd, LOCK_EX);
+
+    if (fstat(fd, &st) != 0)
+    {
+        goto fail;
+    }
+
+    if (st.st_size < (off_t)sizeof(h) || pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) || h.magic == 0)
+    {
+        if (format_file(fd, num_slots) != 0 || fstat(fd, &st) != 0 || pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h))
+        {
+            goto fail;
+        }
+    }
+
+    if (h.magic != DISK_CACHE_MAGIC || h.version != DISK_CACHE_VERSION || h.slot_size != sizeof(disk_slot) ||
+        h.num_slots == 0 || (h.num_slots & (h.num_slots - 1)) != 0 ||
+        (uint64_t)st.st_size != DISK_CACHE_HEADER + h.num_slots * sizeof(disk_slot))
+    {
+        errno = EINVAL;
+        goto fail;
+    }
+
+    d->size = st.st_size;
+    void *map = mmap(NULL, d->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        goto fail;
+    }
+    madvise(map, d->size, MADV_RANDOM);
+
+    flock(fd, LOCK_UN);
+    close(fd); // the mapping keeps the file open
+
+    d->header = map;
+    d->slots = (disk_slot *)((char *)map + DISK_CACHE_HEADER);
+    d->mask = h.num_slots - 1;
+    d->run = __atomic_add_fetch(&d->header->runs, 1, __ATOMIC_RELAXED);
+    d->ttl = ttl_seconds;
+
+    return 0;
+
+fail:;
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return -1;
+}
+
+/*
+Expects four arguments:
+1. a pointer to a disk_cache struct
+2. the hostname
+3. where the address is written on a hit
+4. the size of ip
+
+Returns CACHE_RESOLVED, CACHE_NOT_RESOLVED or CACHE_MISS, as
+cache_lookup() does. Expired entries are misses.
+*/
+int disk_cache_lookup(disk_cache *d, const char *name, char *ip, int size)
+{
+    uint64_t hash = hash_name(name);
+    size_t len = strlen(name);
+    disk_slot slot;
+
+    for (uint64_t i = 0; i < DISK_CACHE_PROBES; i++)
+    {
+        if (!read_slot(d, (hash + i) & d->mask, &slot))
+        {
+            continue;
+        }
+
+        if (slot.hash == hash && slot.name_len == len && memcmp(slot.name, name, len) == 0)
+        {
+            if (slot.expires <= time(NULL))
+            {
+                return CACHE_MISS;
+            }
+            if (slot.state == SLOT_FAILED)
+            {
+                return CACHE_NOT_RESOLVED;
+            }
+
+            strncpy(ip, slot.ip, size - 1);
+            ip[size - 1] = '\0';
+            return CACHE_RESOLVED;
+        }
+    }
+
+    return CACHE_MISS;
+}
+
+/*
+Expects three arguments:
+1. a pointer to a disk_cache struct
+2. the hostname
+3. the address it resolved to, or NULL if it failed to resolve
+
+Stores the result in the slot already holding the name, else in the
+first empty, torn or expired slot of its probe sequence, else in the
+one expiring soonest. A slot another thread is writing is passed
+over. This is a cache, a result that finds no slot is dropped.
+*/
+void disk_cache_store(disk_cache *d, const char *name, const char *ip)
+{
+    uint64_t hash = hash_name(name);
+    size_t len = strlen(name);
+    int64_t now = time(NULL);
+    int64_t victim_expires = INT64_MAX;
+    uint64_t victim = 0;
+    bool found = false;
+    disk_slot slot;
+
+    if (len >= sizeof(slot.name))
+    {
+        return;
+    }
+
+    for (uint64_t i = 0; i < DISK_CACHE_PROBES && !found; i++)
+    {
+        uint64_t at = (hash + i) & d->mask;
+
+        if (writing(d, __atomic_load_n(&d->slots[at].seq, __ATOMIC_RELAXED)))
+        {
+            continue;
+        }
+        if (!read_slot(d, at, &slot) || slot.expires <= now ||
+            (slot.hash == hash && slot.name_len == len && memcmp(slot.name, name, len) == 0))
+        {
+            victim = at;
+            found = true;
+        }
+        else if (slot.expires < victim_expires)
+        {
+            victim = at;
+            victim_expires = slot.expires;
+        }
+    }
+
+    if (!found && victim_expires == INT64_MAX) // every slot was busy
+    {
+        return;
+    }
+
+    memset(&slot, 0, sizeof(slot));
+    slot.hash = hash;
+    slot.expires = now + d->ttl;
+    slot.state = ip != NULL ? SLOT_RESOLVED : SLOT_FAILED;
+    slot.name_len = len;
+    memcpy(slot.name, name, len);
+    if (ip != NULL)
+    {
+        strncpy(slot.ip, ip, sizeof(slot.ip) - 1);
+    }
+    slot.checksum = slot_checksum(&slot);
+
+    // lock the slot: odd, tagged with this run
+    disk_slot *s = &d->slots[victim];
+    uint64_t seq = __atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+    uint64_t locked;
+    do
+    {
+        if (writing(d, seq))
+        {
+            return;
+        }
+        locked = ((uint64_t)d->run << 32) | (((uint32_t)seq + 1) | 1);
+    } while (!__atomic_compare_exchange_n(&s->seq, &seq, locked, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+    __atomic_thread_fence(__ATOMIC_RELEASE); // readers see the slot locked before any of it changes
+
+    store_slot(s, &slot);
+    __atomic_store_n(&s->seq, locked + 1, __ATOMIC_RELEASE);
+}
+
+/*
+Expects as sole argument a pointer to a disk_cache struct
+
+Must only be called once no thread uses the cache. Writes the slots
+back to the file and unmaps it.
+
+Returns 0 on success, -1 if the file could not be written
+*/
+int de_init_disk_cache(disk_cache *d)
+{
+    int res = msync(d->header, d->size, MS_SYNC);
+
+    munmap(d->header, d->size);
+
+    return res == 0 ? 0 : -1;
+}
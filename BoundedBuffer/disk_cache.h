@@ -0,0 +1,91 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+A header file used to implement a resolution cache
+kept in a memory mapped file across runs.
+*/
+
+#ifndef DISK_CACHE_H
+#define DISK_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <arpa/inet.h>
+#include "res_cache.h"
+
+#define DISK_CACHE_MAGIC 0x31484341434c4d00ULL // "\0MLCACH1"
+#define DISK_CACHE_VERSION 1
+#define DISK_CACHE_SLOTS (1 << 20) // slots of a new cache file, a power of two
+#define DISK_CACHE_PROBES 8        // slots tried for a name before one is evicted
+#define DISK_CACHE_TTL 86400       // seconds entries stay valid unless -c says otherwise
+#define DISK_CACHE_HEADER 4096     // the slots start on the second page
+
+/*
+States of a disk_slot
+*/
+#define SLOT_EMPTY 0
+#define SLOT_RESOLVED 1
+#define SLOT_FAILED 2
+
+/*
+Declare a struct of type disk_slot, the result for one hostname.
+
+Each slot is guarded by a sequence lock, seq. The low 32 bits are
+odd while a writer changes the slot, the high 32 bits hold the run
+that last wrote it. A slot left odd by a run that crashed mid-write
+is treated as empty and may be taken over. The checksum covers
+everything after it, so a slot torn by a crash of the machine is
+recognized and ignored as well.
+
+Expiry is wall clock time in seconds, which unlike the monotonic
+clock means the same thing in the next run.
+*/
+typedef struct
+{
+    uint64_t seq;
+    uint64_t checksum;
+    uint64_t hash;
+    int64_t expires;
+    uint32_t state;
+    uint32_t name_len;
+    char ip[INET6_ADDRSTRLEN];
+    char name[256];
+} __attribute__((aligned(8))) disk_slot;
+
+/*
+Declare a struct of type disk_header, the first page of a cache
+file. runs is incremented by every process that opens the file.
+*/
+typedef struct
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t slot_size;
+    uint64_t num_slots;
+    uint32_t runs;
+} disk_header;
+
+/*
+Declare a struct of type disk_cache, an open-addressing hash table
+mapped from a file. Opening it maps the file and checks the header,
+however many entries it holds. Resolver threads read and update the
+slots in place, the kernel writes them back to the file.
+*/
+typedef struct
+{
+    disk_header *header;
+    disk_slot *slots;
+    size_t size;     // bytes mapped
+    uint64_t mask;   // num_slots - 1
+    uint32_t run;
+    int64_t ttl;     // seconds
+} disk_cache;
+
+int init_disk_cache(disk_cache *d, const char *path, size_t num_slots, int ttl_seconds);
+int disk_cache_lookup(disk_cache *d, const char *name, char *ip, int size);
+void disk_cache_store(disk_cache *d, const char *name, const char *ip);
+int de_init_disk_cache(disk_cache *d);
+
+#endif
@@ -0,0 +1,336 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+Microbenchmark of the fifo in shared_array.c. Producer
+threads push items through one fifo to consumer threads,
+and the throughput, latency percentiles and context
+switches of the run are written as a line of CSV.
+
+Items are pointers to payloads, or with -i the payloads
+themselves, copied into the ring.
+*/
+
+#include "shared_array.h"
+#include "metrics.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#define USAGE "Usage: ./fifo_bench [-p <producers>] [-c <consumers>] [-q <capacity>] [-n <items per producer>] [-s <payload bytes>] [-b <batch>] [-l locked|lockfree|adaptive] [-i] [-H]"
+
+#define MAX_BATCH 256
+
+static const char *mode_names[] = {"locked", "lockfree", "adaptive"}; // by fifo_mode
+
+/*
+Declare a struct of type bench_config, the parameters of one run
+*/
+typedef struct
+{
+    int producers;
+    int consumers;
+    int capacity;
+    long items;   // per producer
+    int payload;  // bytes per item, at least the enqueue timestamp
+    int batch;    // items per en_q_n() and de_q_n(), 1 for en_q() and de_q()
+    fifo_mode mode;
+    bool inline_items; // copy payloads into the ring instead of passing pointers to them
+} bench_config;
+
+/*
+Declare a struct of type bench_thread, what one thread measured.
+Each thread writes only its own.
+*/
+typedef struct
+{
+    bench_config *cfg;
+    fifo *q;
+    char *payloads; // producers: items * payload bytes, or with -i batch * payload bytes of scratch
+    uint64_t checksum; // consumers: sum of the payload bytes after the timestamps
+    histogram op;   // ns per en_q or de_q call
+    histogram e2e;  // ns from enqueue to dequeue, consumers only
+} bench_thread;
+
+/*
+Producer thread: stamps each payload with the time it is enqueued.
+With -i the payloads of a batch are built in scratch and copied into
+the ring, otherwise each has a place of its own and the ring carries
+pointers to them.
+*/
+static void *produce(void *arg)
+{
+    bench_thread *t = arg;
+    bench_config *cfg = t->cfg;
+    void *batch[MAX_BATCH];
+
+    for (long i = 0; i < cfg->items; i += cfg->batch)
+    {
+        int n = cfg->items - i < cfg->batch ? cfg->items - i : cfg->batch;
+
+        for (int j = 0; j < n; j++)
+        {
+            char *p = t->payloads + (cfg->inline_items ? j : i + j) * cfg->payload;
+            memset(p + sizeof(uint64_t), (int)(i + j), cfg->payload - sizeof(uint64_t));
+            batch[j] = p;
+        }
+
+        uint64_t now = metrics_now();
+        for (int j = 0; j < n; j++)
+        {
+            __atomic_store_n((uint64_t *)batch[j], now, __ATOMIC_RELAXED);
+        }
+
+        if (cfg->inline_items)
+        {
+            en_q_items(t->q, t->payloads, n);
+        }
+        else if (n == 1)
+        {
+            en_q(t->q, batch[0]);
+        }
+        else
+        {
+            en_q_n(t->q, batch, n);
+        }
+        histogram_add(&t->op, metrics_now() - now);
+    }
+
+    return NULL;
+}
+
+/*
+Consumer thread: reads every payload it receives until the fifo is
+closed and drained.
+*/
+static void *consume(void *arg)
+{
+    bench_thread *t = arg;
+    bench_config *cfg = t->cfg;
+    void *batch[MAX_BATCH];
+
+    for (;;)
+    {
+        uint64_t started = metrics_now();
+        int n;
+        if (cfg->inline_items)
+        {
+            n = de_q_items(t->q, t->payloads, cfg->batch);
+        }
+        else
+        {
+            n = cfg->batch == 1 ? (de_q(t->q, batch) == FIFO_CLOSED ? FIFO_CLOSED : 1) : de_q_n(t->q, batch, cfg->batch);
+        }
+        uint64_t ended = metrics_now();
+
+        if (n == FIFO_CLOSED)
+        {
+            return NULL;
+        }
+        histogram_add(&t->op, ended - started);
+
+        for (int j = 0; j < n; j++)
+        {
+            const unsigned char *p = cfg->inline_items ? (unsigned char *)t->payloads + j * cfg->payload : batch[j];
+            uint64_t stamp = __atomic_load_n((const uint64_t *)p, __ATOMIC_RELAXED);
+
+            histogram_add(&t->e2e, ended > stamp ? ended - stamp : 0);
+            for (int k = sizeof(uint64_t); k < cfg->payload; k++)
+            {
+                t->checksum += p[k];
+            }
+        }
+    }
+}
+
+static void print_percentiles(const histogram *h)
+{
+    printf(",%lu,%lu,%lu", (unsigned long)histogram_percentile(h, 0.5), (unsigned long)histogram_percentile(h, 0.99),
+           (unsigned long)histogram_percentile(h, 0.999));
+}
+
+int main(int argc, char *argv[])
+{
+    bench_config cfg = {.producers = 1, .consumers = 1, .capacity = BUFFER_SIZE, .items = 1000000, .payload = 8, .batch = 1, .mode = FIFO_LOCK_FREE};
+    bool header = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:c:q:n:s:b:l:iH")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            cfg.producers = atoi(optarg);
+            break;
+        case 'c':
+            cfg.consumers = atoi(optarg);
+            break;
+        case 'q':
+            cfg.capacity = atoi(optarg);
+            break;
+        case 'n':
+            cfg.items = atol(optarg);
+            break;
+        case 's':
+            cfg.payload = atoi(optarg);
+            break;
+        case 'b':
+            cfg.batch = atoi(optarg);
+            break;
+        case 'l':
+            if (strcmp(optarg, "locked") == 0)
+            {
+                cfg.mode = FIFO_LOCKED;
+            }
+            else if (strcmp(optarg, "lockfree") == 0)
+            {
+                cfg.mode = FIFO_LOCK_FREE;
+            }
+            else if (strcmp(optarg, "adaptive") == 0)
+            {
+                cfg.mode = FIFO_ADAPTIVE;
+            }
+            else
+            {
+                puts(USAGE);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'i':
+            cfg.inline_items = true;
+            break;
+        case 'H':
+            header = true;
+            break;
+        default:
+            puts(USAGE);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (cfg.producers < 1 || cfg.consumers < 1 || cfg.capacity < 1 || cfg.capacity > MAX_BUFFER_SIZE || cfg.items < 1 ||
+        cfg.batch < 1 || cfg.batch > MAX_BATCH)
+    {
+        puts(USAGE);
+        return EXIT_FAILURE;
+    }
+    if (cfg.payload < (int)sizeof(uint64_t)) // room for the timestamp
+    {
+        cfg.payload = sizeof(uint64_t);
+    }
+
+    fifo q;
+    if ((cfg.inline_items ? init_q_items(&q, cfg.capacity, cfg.mode, cfg.payload, sizeof(uint64_t))
+                          : init_q(&q, cfg.capacity, cfg.mode)) != 0)
+    {
+        perror("Unable to allocate the fifo");
+        return EXIT_FAILURE;
+    }
+
+    int num_threads = cfg.producers + cfg.consumers;
+    bench_thread *threads = calloc(num_threads, sizeof(bench_thread));
+    pthread_t *ids = calloc(num_threads, sizeof(pthread_t));
+    if (threads == NULL || ids == NULL)
+    {
+        perror("Unable to allocate the threads");
+        return EXIT_FAILURE;
+    }
+
+    // payloads are written before the clock starts, so page faults are not measured
+    for (int i = 0; i < num_threads; i++)
+    {
+        threads[i].cfg = &cfg;
+        threads[i].q = &q;
+        if (i < cfg.producers || cfg.inline_items)
+        {
+            size_t bytes = (cfg.inline_items ? cfg.batch : cfg.items) * cfg.payload;
+            threads[i].payloads = malloc(bytes);
+            if (threads[i].payloads == NULL)
+            {
+                perror("Unable to allocate the payloads");
+                return EXIT_FAILURE;
+            }
+            memset(threads[i].payloads, 0, bytes);
+        }
+    }
+
+    struct rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    uint64_t start = metrics_now();
+
+    for (int i = 0; i < num_threads; i++)
+    {
+        if (pthread_create(&ids[i], NULL, i < cfg.producers ? &produce : &consume, &threads[i]) != 0)
+        {
+            perror("Unable to create thread");
+            return EXIT_FAILURE;
+        }
+    }
+    for (int i = 0; i < cfg.producers; i++)
+    {
+        pthread_join(ids[i], NULL);
+    }
+    close_q(&q); // every en_q has returned
+    for (int i = cfg.producers; i < num_threads; i++)
+    {
+        pthread_join(ids[i], NULL);
+    }
+
+    double seconds = (metrics_now() - start) / 1e9;
+    getrusage(RUSAGE_SELF, &after);
+
+    static histogram enq, deq, e2e;
+    uint64_t checksum = 0;
+    for (int i = 0; i < num_threads; i++)
+    {
+        histogram_merge(i < cfg.producers ? &enq : &deq, &threads[i].op);
+        histogram_merge(&e2e, &threads[i].e2e);
+        checksum += threads[i].checksum;
+    }
+
+    long total = cfg.items * cfg.producers;
+    if ((long)e2e.count != total)
+    {
+        fprintf(stderr, "Lost items: %lu of %ld arrived\n", (unsigned long)e2e.count, total);
+        return EXIT_FAILURE;
+    }
+
+    // item i of every producer is filled with byte i, so an item lost, duplicated or torn changes the sum
+    uint64_t expected = 0;
+    for (long i = 0; i < cfg.items; i++)
+    {
+        expected += (uint64_t)(i & 0xff) * (cfg.payload - sizeof(uint64_t));
+    }
+    expected *= cfg.producers;
+    if (checksum != expected)
+    {
+        fprintf(stderr, "Corrupted items: payload checksum %lu, expected %lu\n", (unsigned long)checksum, (unsigned long)expected);
+        return EXIT_FAILURE;
+    }
+
+    if (header)
+    {
+        puts("mode,producers,consumers,capacity,payload,inline,batch,items,seconds,ops_per_sec,"
+             "enq_p50_ns,enq_p99_ns,enq_p999_ns,deq_p50_ns,deq_p99_ns,deq_p999_ns,e2e_p50_ns,e2e_p99_ns,e2e_p999_ns,"
+             "voluntary_csw,involuntary_csw");
+    }
+    printf("%s,%d,%d,%lu,%d,%d,%d,%ld,%.6f,%.0f", mode_names[cfg.mode], cfg.producers, cfg.consumers,
+           (unsigned long)q.capacity, cfg.payload, cfg.inline_items, cfg.batch, total, seconds, total / seconds);
+    print_percentiles(&enq);
+    print_percentiles(&deq);
+    print_percentiles(&e2e);
+    printf(",%ld,%ld\n", after.ru_nvcsw - before.ru_nvcsw, after.ru_nivcsw - before.ru_nivcsw);
+
+    for (int i = 0; i < num_threads; i++)
+    {
+        free(threads[i].payloads); // NULL for consumers without -i
+    }
+    free(threads);
+    free(ids);
+    de_init_q(&q);
+
+    return EXIT_SUCCESS;
+}
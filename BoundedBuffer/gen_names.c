@@ -0,0 +1,242 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+Generator of synthetic hostname files for multi-lookup.
+The same seed always produces the same files.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#define USAGE "Usage: ./gen_names [-n <names>] [-f <files>] [-d <duplicate ratio>] [-l <mean length>] [-L <max length>] [-z <file size skew>] [-s <seed>] [-o <path prefix>]"
+
+#define MIN_NAME_LENGTH 4   // "a.io"
+#define MAX_NAME_LENGTH 253 // longest name DNS allows
+#define MAX_LABEL_LENGTH 63
+
+static const char *tlds[] = {"com", "net", "org", "io", "edu", "gov", "de", "uk", "jp", "fr", "info", "dev"};
+static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+
+/*
+Returns 64 random bits, splitmix64.
+*/
+static uint64_t next_random(uint64_t *state)
+{
+    uint64_t x = (*state += 0x9e3779b97f4a7c15ULL);
+
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/*
+Returns a random number in [0, 1).
+*/
+static double next_unit(uint64_t *state)
+{
+    return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+Draws a name length: MIN_NAME_LENGTH plus an exponentially
+distributed excess, so most names are near the mean and a few are
+much longer, as in real lists. Capped at max.
+*/
+static int draw_length(uint64_t *state, double mean, int max)
+{
+    double excess = -log(1.0 - next_unit(state)) * (mean - MIN_NAME_LENGTH);
+    int len = MIN_NAME_LENGTH + (int)excess;
+
+    return len < max ? len : max;
+}
+
+/*
+Writes a random hostname of about len characters into buf: labels of
+letters and digits, separated by dots, under a common top level
+domain. The first label is the serial number in hex and nothing
+else, so no two names are the same. A name too short for more than
+that label and the top level domain comes out longer than len.
+
+Returns the length of the name.
+*/
+static int make_name(uint64_t *state, uint64_t serial, int len, char *buf)
+{
+    const char *tld = tlds[next_random(state) % (sizeof(tlds) / sizeof(tlds[0]))];
+    int tld_len = strlen(tld);
+    int n = sprintf(buf, "%lx", (unsigned long)serial); // the unique first label
+    int body = len - tld_len - 1;
+    int label = 0;
+
+    // random labels only after a dot, or a serial followed by letters could spell another serial
+    if (n < body - 1)
+    {
+        buf[n++] = '.';
+    }
+    else
+    {
+        body = n;
+    }
+    while (n < body)
+    {
+        // start a new label now and then, never an empty one or one at the end
+        if (label >= MAX_LABEL_LENGTH || (label > 2 && n < body - 2 && next_random(state) % 8 == 0))
+        {
+            buf[n++] = '.';
+            label = 0;
+            continue;
+        }
+        buf[n++] = alphabet[next_random(state) % (sizeof(alphabet) - 1)];
+        label++;
+    }
+
+    buf[n++] = '.';
+    memcpy(buf + n, tld, tld_len);
+    n += tld_len;
+    buf[n] = '\0';
+
+    return n;
+}
+
+int main(int argc, char *argv[])
+{
+    long count = 10000;
+    int num_files = 5;
+    double dup_ratio = 0.0;
+    double mean_len = 16.0;
+    int max_len = 64;
+    double skew = 0.0;
+    uint64_t seed = 1;
+    const char *prefix = "input/names";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:f:d:l:L:z:s:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            count = atol(optarg);
+            break;
+        case 'f':
+            num_files = atoi(optarg);
+            break;
+        case 'd':
+            dup_ratio = atof(optarg);
+            break;
+        case 'l':
+            mean_len = atof(optarg);
+            break;
+        case 'L':
+            max_len = atoi(optarg);
+            break;
+        case 'z':
+            skew = atof(optarg);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'o':
+            prefix = optarg;
+            break;
+        default:
+            puts(USAGE);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (count < 1 || num_files < 1 || dup_ratio < 0 || dup_ratio >= 1 || skew < 0 || max_len > MAX_NAME_LENGTH ||
+        max_len < MIN_NAME_LENGTH + 8 || mean_len <= MIN_NAME_LENGTH || mean_len > max_len)
+    {
+        fprintf(stderr, "Need at least one name and file, a duplicate ratio in [0, 1), a skew of 0 or more, and\n"
+                        "%d < mean length <= max length <= %d with max length at least %d\n",
+                MIN_NAME_LENGTH, MAX_NAME_LENGTH, MIN_NAME_LENGTH + 8);
+        puts(USAGE);
+        return EXIT_FAILURE;
+    }
+
+    // file i receives a share of the names proportional to 1 / (i + 1)^skew
+    double *cumulative = malloc(num_files * sizeof(double));
+    FILE **files = calloc(num_files, sizeof(FILE *));
+    char **names = malloc(count * sizeof(char *)); // names written so far, duplicates repeat one of them
+    if (cumulative == NULL || files == NULL || names == NULL)
+    {
+        perror("Unable to allocate the generator");
+        return EXIT_FAILURE;
+    }
+
+    double total = 0;
+    for (int i = 0; i < num_files; i++)
+    {
+        total += 1.0 / pow(i + 1, skew);
+        cumulative[i] = total;
+    }
+
+    for (int i = 0; i < num_files; i++)
+    {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s%d.txt", prefix, i + 1);
+        files[i] = fopen(path, "w");
+        if (files[i] == NULL)
+        {
+            perror(path);
+            return EXIT_FAILURE;
+        }
+    }
+
+    uint64_t state = seed;
+    long unique = 0;
+    for (long i = 0; i < count; i++)
+    {
+        char buf[MAX_NAME_LENGTH + 1];
+        const char *name;
+
+        if (unique > 0 && next_unit(&state) < dup_ratio)
+        {
+            name = names[next_random(&state) % unique];
+        }
+        else
+        {
+            int len = make_name(&state, unique, draw_length(&state, mean_len, max_len), buf);
+            names[unique] = malloc(len + 1);
+            if (names[unique] == NULL)
+            {
+                perror("Unable to allocate a name");
+                return EXIT_FAILURE;
+            }
+            memcpy(names[unique], buf, len + 1);
+            name = names[unique++];
+        }
+
+        double pick = next_unit(&state) * total;
+        int f = 0;
+        while (f < num_files - 1 && cumulative[f] <= pick)
+        {
+            f++;
+        }
+        fprintf(files[f], "%s\n", name);
+    }
+
+    for (int i = 0; i < num_files; i++)
+    {
+        if (fclose(files[i]) != 0)
+        {
+            perror("Unable to write a file");
+            return EXIT_FAILURE;
+        }
+    }
+    for (long i = 0; i < unique; i++)
+    {
+        free(names[i]);
+    }
+    free(names);
+    free(files);
+    free(cumulative);
+
+    printf("%ld names, %ld unique, in %d files\n", count, unique, num_files);
+    return EXIT_SUCCESS;
+}
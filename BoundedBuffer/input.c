@@ -0,0 +1,163 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+Implementation of memory mapped data files
+shared by requesters and resolvers.
+*/
+
+#include "input.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+Maps a data file read only.
+
+Expects as sole argument the path of the file.
+
+The mapping is advised as sequential so the kernel reads ahead
+aggressively. The descriptor is closed right away, the mapping
+keeps the file open. An empty file gets no mapping at all.
+
+Returns the file with one reference held by the caller, or NULL
+with errno set if it could not be opened or mapped.
+*/
+input_file *map_input(const char *path)
+{
+    struct stat st;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    input_file *f = malloc(sizeof(input_file));
+    if (f == NULL)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    f->size = st.st_size;
+    f->refs = 1;
+    f->data = NULL;
+
+    if (f->size > 0)
+    {
+        f->data = mmap(NULL, f->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (f->data == MAP_FAILED)
+        {
+            close(fd);
+            free(f);
+            return NULL;
+        }
+        madvise(f->data, f->size, MADV_SEQUENTIAL);
+    }
+
+    close(fd);
+
+    return f;
+}
+
+/*
+Cuts a data file into chunks of chunk_size bytes for requesters to
+claim one at a time.
+
+Expects four arguments:
+1. the path of the file
+2. the size of a chunk in bytes
+3. whether to map the file, in which case every chunk holds a
+   reference on the mapping
+4. where to store the number of chunks
+
+An empty file still yields one (empty) chunk.
+
+Returns an array of chunks to be freed by the caller, or NULL with
+errno set if the file could not be opened or mapped.
+*/
+input_chunk *split_input(const char *path, off_t chunk_size, bool map, int *count)
+{
+    struct stat st;
+    input_file *f = NULL;
+    off_t size;
+
+    if (map)
+    {
+        f = map_input(path);
+        if (f == NULL)
+        {
+            return NULL;
+        }
+        size = f->size;
+    }
+    else
+    {
+        if (stat(path, &st) != 0)
+        {
+            return NULL;
+        }
+        size = st.st_size;
+    }
+
+    int n = size > 0 ? (size + chunk_size - 1) / chunk_size : 1;
+    input_chunk *chunks = malloc(n * sizeof(input_chunk));
+    if (chunks == NULL)
+    {
+        if (f != NULL)
+        {
+            release_input(f);
+        }
+        return NULL;
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        chunks[i].path = path;
+        chunks[i].map = f;
+        chunks[i].lo = i * chunk_size;
+        chunks[i].hi = i == n - 1 ? size : (i + 1) * chunk_size;
+    }
+
+    if (f != NULL)
+    {
+        hold_input(f, n - 1); // map_input() returned the first reference
+    }
+
+    *count = n;
+    return chunks;
+}
+
+/*
+Takes n more references, one for each hostname about to be handed
+to the resolvers.
+*/
+void hold_input(input_file *f, int n)
+{
+    __atomic_add_fetch(&f->refs, n, __ATOMIC_RELAXED);
+}
+
+/*
+Drops one reference and unmaps the file once none remain.
+*/
+void release_input(input_file *f)
+{
+    if (__atomic_sub_fetch(&f->refs, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        if (f->data != NULL)
+        {
+            munmap(f->data, f->size);
+        }
+        free(f);
+    }
+}
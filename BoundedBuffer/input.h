@@ -0,0 +1,55 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+A header file used to implement memory mapped
+data files shared by requesters and resolvers.
+*/
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+Declare a struct of type input_file, a data file mapped read only.
+
+Hostnames are passed to resolvers as slices of the mapping rather
+than copies, so the mapping must outlive every slice. Member refs
+counts the chunks of the file not yet parsed plus every hostname
+still in flight, and the file is unmapped when it drops to zero.
+*/
+typedef struct
+{
+    char *data;
+    size_t size;
+    int refs;
+} input_file;
+
+/*
+Declare a struct of type input_chunk, the unit of requester work.
+
+A chunk holds the lines of a data file that start within bytes
+[lo, hi). The last of them may run past hi and a line that starts
+before lo belongs to the previous chunk, so files can be cut at any
+byte offset without scanning for newlines up front.
+*/
+typedef struct
+{
+    const char *path;
+    input_file *map; // shared by every chunk of the file when mapped, else NULL
+    off_t lo;
+    off_t hi;
+    uint64_t index;  // position among the chunks of all files, in input order
+} input_chunk;
+
+input_file *map_input(const char *path);
+input_chunk *split_input(const char *path, off_t chunk_size, bool map, int *count);
+void hold_input(input_file *f, int n);
+void release_input(input_file *f);
+
+#endif
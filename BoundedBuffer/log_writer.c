@@ -0,0 +1,246 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+Implementation of the log writer thread.
+*/
+
+#include "log_writer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+/*
+Writes all of iov to fd, resuming after short writes.
+
+Returns 0 on success, -1 with errno set on failure.
+*/
+static int write_all(int fd, struct iovec *iov, int count)
+{
+    while (count > 0)
+    {
+        ssize_t done = writev(fd, iov, count);
+        if (done < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+
+        // skip the buffers written completely, then the written part of the next
+        while (count > 0 && (size_t)done >= iov->iov_len)
+        {
+            done -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + done;
+            iov->iov_len -= done;
+        }
+    }
+
+    return 0;
+}
+
+/*
+Start routine of the writer thread.
+
+Takes up to LOG_WRITE_BATCH full buffers at a time and writes those
+of each file with a single writev(), keeping the order in which they
+were queued. Exits once the full queue is closed and drained.
+*/
+static void *write_logs(void *arguments)
+{
+    log_writer *w = arguments;
+    void *batch[LOG_WRITE_BATCH];
+    struct iovec iov[LOG_WRITE_BATCH];
+    bool written[LOG_WRITE_BATCH];
+    int batched;
+
+    while ((batched = de_q_n(&w->full, batch, LOG_WRITE_BATCH)) != FIFO_CLOSED)
+    {
+        for (int i = 0; i < batched; i++)
+        {
+            written[i] = false;
+        }
+
+        for (int i = 0; i < batched; i++)
+        {
+            if (written[i])
+            {
+                continue;
+            }
+
+            int fd = ((log_buf *)batch[i])->fd;
+            int count = 0;
+            for (int j = i; j < batched; j++)
+            {
+                log_buf *b = batch[j];
+                if (!written[j] && b->fd == fd)
+                {
+                    iov[count].iov_base = b->data;
+                    iov[count].iov_len = b->len;
+                    count++;
+                    written[j] = true;
+                }
+            }
+
+            if (write_all(fd, iov, count) != 0)
+            {
+                perror("Unable to write log file");
+            }
+        }
+
+        en_q_n(&w->free, batch, batched);
+    }
+
+    return NULL;
+}
+
+/*
+Expects two arguments:
+1. a pointer to a log_writer struct
+2. the most log streams that will be open at once
+
+Allocates the buffers and starts the writer thread.
+
+Returns 0 on success, -1 if memory or the thread could not be had
+*/
+int init_log_writer(log_writer *w, int num_streams)
+{
+    w->num_bufs = 2 * num_streams + LOG_SPARE_BUFS;
+    w->bufs = malloc(w->num_bufs * sizeof(log_buf));
+    if (w->bufs == NULL)
+    {
+        return -1;
+    }
+
+    if (init_q(&w->free, w->num_bufs, FIFO_LOCK_FREE) != 0)
+    {
+        free(w->bufs);
+        return -1;
+    }
+    if (init_q(&w->full, w->num_bufs, FIFO_LOCK_FREE) != 0)
+    {
+        de_init_q(&w->free);
+        free(w->bufs);
+        return -1;
+    }
+
+    for (int i = 0; i < w->num_bufs; i++)
+    {
+        en_q(&w->free, &w->bufs[i]);
+    }
+
+    if (pthread_create(&w->thread, NULL, &write_logs, w) != 0)
+    {
+        de_init_q(&w->free);
+        de_init_q(&w->full);
+        free(w->bufs);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+Expects three arguments:
+1. a pointer to the log_stream struct to set up
+2. the writer that will write its lines
+3. the descriptor of the log file
+*/
+void init_log_stream(log_stream *s, log_writer *w, int fd)
+{
+    s->w = w;
+    s->fd = fd;
+    s->buf = NULL;
+}
+
+/*
+Hands the lines collected by a stream to the writer thread. Called
+when the buffer fills, and by the owning thread before it exits.
+*/
+void log_flush(log_stream *s)
+{
+    if (s->buf == NULL)
+    {
+        return;
+    }
+
+    en_q(&s->w->full, s->buf);
+    s->buf = NULL;
+}
+
+/*
+Appends one formatted line to a stream, like fprintf(). The line is
+written to the file some time later by the writer thread.
+
+Waits for an empty buffer if the writer has fallen behind. A line
+longer than a whole buffer is truncated.
+*/
+void log_printf(log_stream *s, const char *format, ...)
+{
+    va_list ap;
+
+    for (;;)
+    {
+        if (s->buf == NULL)
+        {
+            void *buf;
+            de_q(&s->w->free, &buf);
+            s->buf = buf;
+            s->buf->fd = s->fd;
+            s->buf->len = 0;
+        }
+
+        size_t room = LOG_BUF_SIZE - s->buf->len;
+        va_start(ap, format);
+        int n = vsnprintf(s->buf->data + s->buf->len, room, format, ap);
+        va_end(ap);
+
+        if (n < 0)
+        {
+            return;
+        }
+        if ((size_t)n < room)
+        {
+            s->buf->len += n;
+            return;
+        }
+        if (s->buf->len == 0)
+        {
+            s->buf->len = room - 1; // vsnprintf() kept room for the terminator
+            return;
+        }
+
+        log_flush(s); // try again with an empty buffer
+    }
+}
+
+/*
+Expects as sole argument a pointer to a log_writer struct
+
+Must only be called once every stream has been flushed. Waits for
+the writer thread to write everything queued, then frees the buffers.
+
+Returns 0 on success
+*/
+int de_init_log_writer(log_writer *w)
+{
+    close_q(&w->full);
+    pthread_join(w->thread, NULL);
+
+    de_init_q(&w->free);
+    de_init_q(&w->full);
+    free(w->bufs);
+
+    return 0;
+}
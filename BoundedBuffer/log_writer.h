@@ -0,0 +1,67 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+A header file used to implement a log writer thread
+that takes log output off the requester and resolver
+critical paths.
+*/
+
+#ifndef LOG_WRITER_H
+#define LOG_WRITER_H
+
+#include "shared_array.h"
+#include <pthread.h>
+#include <stddef.h>
+
+#define LOG_BUF_SIZE (64 * 1024) // bytes of log lines a thread collects before handing them over
+#define LOG_SPARE_BUFS 8          // buffers beyond two per stream, so streams rarely wait
+#define LOG_WRITE_BATCH 64        // buffers written per round of writev() calls
+
+/*
+Declare a struct of type log_buf, a block of complete log lines
+destined for one file.
+*/
+typedef struct
+{
+    int fd;
+    size_t len;
+    char data[LOG_BUF_SIZE];
+} log_buf;
+
+/*
+Declare a struct of type log_writer.
+
+Buffers circulate between two lock-free queues: threads take empty
+ones from free, fill them and put them on full. The writer thread
+drains full, writes the buffers for each file with one writev() call
+and returns them to free.
+*/
+typedef struct
+{
+    fifo free;
+    fifo full;
+    log_buf *bufs;
+    int num_bufs;
+    pthread_t thread;
+} log_writer;
+
+/*
+Declare a struct of type log_stream, one thread's output to one
+log file. Not shared between threads.
+*/
+typedef struct
+{
+    log_writer *w;
+    int fd;
+    log_buf *buf; // lines not yet handed to the writer, NULL if none
+} log_stream;
+
+int init_log_writer(log_writer *w, int num_streams);
+void init_log_stream(log_stream *s, log_writer *w, int fd);
+void log_printf(log_stream *s, const char *format, ...) __attribute__((format(printf, 2, 3)));
+void log_flush(log_stream *s);
+int de_init_log_writer(log_writer *w);
+
+#endif
@@ -0,0 +1,325 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+Implementation of latency metrics collected per
+thread and reported as JSON.
+*/
+
+#include "metrics.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+What the calling thread measures, NULL if it has not joined
+*/
+static __thread metrics_thread *current;
+
+static const char *stage_names[NUM_STAGES] = {"parse", "queue", "dispatch", "lookup", "total"};
+
+/*
+Returns CLOCK_MONOTONIC in nanoseconds.
+*/
+uint64_t metrics_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int bucket_of(uint64_t v)
+{
+    if (v < (1 << HIST_SUB_BITS))
+    {
+        return v;
+    }
+
+    int shift = 63 - __builtin_clzll(v) - HIST_SUB_BITS;
+    return ((shift + 1) << HIST_SUB_BITS) + ((v >> shift) & ((1 << HIST_SUB_BITS) - 1));
+}
+
+/*
+Returns the middle of the values counted in bucket b.
+*/
+static uint64_t value_of(int b)
+{
+    if (b < (1 << HIST_SUB_BITS))
+    {
+        return b;
+    }
+
+    int shift = (b >> HIST_SUB_BITS) - 1;
+    uint64_t low = (uint64_t)((1 << HIST_SUB_BITS) + (b & ((1 << HIST_SUB_BITS) - 1))) << shift;
+    return low + ((1ULL << shift) >> 1);
+}
+
+/*
+Counts one value in a histogram.
+*/
+void histogram_add(histogram *h, uint64_t v)
+{
+    h->buckets[bucket_of(v)]++;
+    h->count++;
+    if (v > h->max)
+    {
+        h->max = v;
+    }
+}
+
+/*
+Adds the counts of histogram from into histogram to.
+*/
+void histogram_merge(histogram *to, const histogram *from)
+{
+    to->count += from->count;
+    to->max = from->max > to->max ? from->max : to->max;
+    for (int b = 0; b < HIST_BUCKETS; b++)
+    {
+        to->buckets[b] += from->buckets[b];
+    }
+}
+
+/*
+Returns the value below which a fraction q of the values lie.
+*/
+uint64_t histogram_percentile(const histogram *h, double q)
+{
+    uint64_t rank = (uint64_t)(q * h->count + 0.5);
+    uint64_t seen = 0;
+
+    if (rank == 0)
+    {
+        rank = 1;
+    }
+
+    for (int b = 0; b < HIST_BUCKETS; b++)
+    {
+        seen += h->buckets[b];
+        if (seen >= rank)
+        {
+            uint64_t v = value_of(b);
+            return v < h->max ? v : h->max;
+        }
+    }
+
+    return h->max;
+}
+
+/*
+Expects as sole argument a pointer to a metrics struct
+
+Returns 0 on success
+*/
+int init_metrics(metrics *m)
+{
+    m->start = metrics_now();
+    m->threads = NULL;
+    pthread_mutex_init(&m->lock, NULL);
+
+    return 0;
+}
+
+/*
+Registers the calling thread, which measures into its own histograms
+from now on. role names the thread in the report.
+
+Returns 0 on success, -1 if memory could not be allocated
+*/
+int metrics_join(metrics *m, const char *role)
+{
+    metrics_thread *t = calloc(1, sizeof(metrics_thread));
+    if (t == NULL)
+    {
+        return -1;
+    }
+
+    t->owner = m;
+    t->role = role;
+    t->started = metrics_now() - m->start;
+
+    pthread_mutex_lock(&m->lock);
+    t->next = m->threads;
+    m->threads = t;
+    pthread_mutex_unlock(&m->lock);
+
+    current = t;
+    return 0;
+}
+
+/*
+Marks the end of the calling thread's lifetime.
+*/
+void metrics_leave(void)
+{
+    if (current != NULL)
+    {
+        current->ended = metrics_now() - current->owner->start;
+        current = NULL;
+    }
+}
+
+/*
+Returns whether the calling thread measures anything, so callers
+can skip reading the clock when it does not.
+*/
+bool metrics_on(void)
+{
+    return current != NULL;
+}
+
+/*
+Counts one hostname that spent ns nanoseconds in a stage.
+*/
+void metrics_record(metric_stage stage, uint64_t ns)
+{
+    if (current == NULL)
+    {
+        return;
+    }
+
+    histogram_add(&current->stages[stage], ns);
+}
+
+/*
+Adds ns nanoseconds of work to the calling thread's utilization.
+*/
+void metrics_busy(uint64_t ns)
+{
+    if (current != NULL)
+    {
+        current->busy += ns;
+    }
+}
+
+/*
+Counts one hostname completed at time now (see metrics_now()).
+*/
+void metrics_done(uint64_t now)
+{
+    if (current == NULL)
+    {
+        return;
+    }
+
+    int second = (now - current->owner->start) / 1000000000ULL;
+    if (second >= current->seconds)
+    {
+        int seconds = second + 1 > 2 * current->seconds ? second + 1 : 2 * current->seconds;
+        uint64_t *per_second = realloc(current->per_second, seconds * sizeof(uint64_t));
+        if (per_second == NULL)
+        {
+            return;
+        }
+        memset(per_second + current->seconds, 0, (seconds - current->seconds) * sizeof(uint64_t));
+        current->per_second = per_second;
+        current->seconds = seconds;
+    }
+
+    current->per_second[second]++;
+    if (second >= current->used)
+    {
+        current->used = second + 1;
+    }
+    current->items++;
+}
+
+/*
+Expects two arguments:
+1. a pointer to a metrics struct
+2. the file to write to
+
+Must only be called once every registered thread has ended. Writes
+percentiles of every stage over all threads, completions per second
+and the utilization of each thread, times in microseconds.
+
+Returns 0 on success, -1 if the report could not be written
+*/
+int write_metrics(metrics *m, FILE *out)
+{
+    static histogram merged[NUM_STAGES];
+    uint64_t *per_second = NULL;
+    int seconds = 0;
+    uint64_t items = 0;
+    double elapsed = (metrics_now() - m->start) / 1e9;
+
+    memset(merged, 0, sizeof(merged));
+    for (metrics_thread *t = m->threads; t != NULL; t = t->next)
+    {
+        for (int s = 0; s < NUM_STAGES; s++)
+        {
+            histogram_merge(&merged[s], &t->stages[s]);
+        }
+
+        // the entries past the last used one were only allocated ahead
+        if (t->used > seconds)
+        {
+            uint64_t *grown = realloc(per_second, t->used * sizeof(uint64_t));
+            if (grown == NULL)
+            {
+                free(per_second);
+                return -1;
+            }
+            memset(grown + seconds, 0, (t->used - seconds) * sizeof(uint64_t));
+            per_second = grown;
+            seconds = t->used;
+        }
+        for (int i = 0; i < t->used; i++)
+        {
+            per_second[i] += t->per_second[i];
+        }
+        items += t->items;
+    }
+
+    fprintf(out, "{\n  \"elapsed_s\": %.6f,\n  \"hostnames\": %lu,\n  \"stages_us\": {\n", elapsed, (unsigned long)items);
+    for (int s = 0; s < NUM_STAGES; s++)
+    {
+        const histogram *h = &merged[s];
+        fprintf(out, "    \"%s\": {\"count\": %lu, \"p50\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f}%s\n",
+                stage_names[s], (unsigned long)h->count, histogram_percentile(h, 0.5) / 1e3,
+                histogram_percentile(h, 0.99) / 1e3, histogram_percentile(h, 0.999) / 1e3, h->max / 1e3, s < NUM_STAGES - 1 ? "," : "");
+    }
+
+    // the last second is cut short by the end of the run
+    fprintf(out, "  },\n  \"per_second\": [");
+    for (int i = 0; i < seconds; i++)
+    {
+        fprintf(out, "%s%lu", i > 0 ? ", " : "", (unsigned long)per_second[i]);
+    }
+
+    fprintf(out, "],\n  \"threads\": [\n");
+    for (metrics_thread *t = m->threads; t != NULL; t = t->next)
+    {
+        uint64_t lifetime = t->ended > t->started ? t->ended - t->started : 0;
+        fprintf(out, "    {\"role\": \"%s\", \"items\": %lu, \"lifetime_s\": %.6f, \"busy_s\": %.6f, \"utilization\": %.3f}%s\n",
+                t->role, (unsigned long)t->items, lifetime / 1e9, t->busy / 1e9,
+                lifetime > 0 ? (double)t->busy / lifetime : 0.0, t->next != NULL ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+
+    free(per_second);
+    return ferror(out) ? -1 : 0;
+}
+
+/*
+Expects as sole argument a pointer to a metrics struct
+
+Returns 0 on success
+*/
+int de_init_metrics(metrics *m)
+{
+    metrics_thread *t = m->threads;
+
+    while (t != NULL)
+    {
+        metrics_thread *next = t->next;
+        free(t->per_second);
+        free(t);
+        t = next;
+    }
+    pthread_mutex_destroy(&m->lock);
+
+    return 0;
+}
@@ -0,0 +1,92 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+A header file used to implement latency metrics
+collected per thread and reported as JSON.
+*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define HIST_SUB_BITS 3 // 8 buckets per power of two, values are kept within 12.5%
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+
+/*
+The stages a hostname passes through, each timed separately
+*/
+typedef enum
+{
+    STAGE_PARSE,    // read from the input until handed to the shared array
+    STAGE_QUEUE,    // waiting in the shared array
+    STAGE_DISPATCH, // taken from the shared array until its lookup starts
+    STAGE_LOOKUP,   // cache and resolver backend
+    STAGE_TOTAL,    // read from the input until its lookup ended
+    NUM_STAGES
+} metric_stage;
+
+/*
+Declare a struct of type histogram, counts of nanosecond values in
+log-linear buckets: exact below 2^HIST_SUB_BITS, then 2^HIST_SUB_BITS
+buckets for every power of two.
+*/
+typedef struct
+{
+    uint64_t count;
+    uint64_t max;
+    uint64_t buckets[HIST_BUCKETS];
+} histogram;
+
+struct metrics;
+
+/*
+Declare a struct of type metrics_thread, what one thread measured.
+Written by its thread only, read once the thread has ended.
+*/
+typedef struct metrics_thread
+{
+    struct metrics_thread *next;
+    struct metrics *owner;
+    const char *role;
+    uint64_t started;     // ns since the metrics were set up
+    uint64_t ended;
+    uint64_t busy;        // ns spent working rather than waiting
+    uint64_t items;
+    uint64_t *per_second; // items completed in each second since the start
+    int seconds;          // entries allocated
+    int used;             // up to the last second an item was completed in
+    histogram stages[NUM_STAGES];
+} metrics_thread;
+
+/*
+Declare a struct of type metrics, the threads that registered with
+metrics_join(). The lock is only taken to register.
+*/
+typedef struct metrics
+{
+    uint64_t start; // CLOCK_MONOTONIC ns
+    pthread_mutex_t lock;
+    metrics_thread *threads;
+} metrics;
+
+uint64_t metrics_now(void);
+void histogram_add(histogram *h, uint64_t v);
+void histogram_merge(histogram *to, const histogram *from);
+uint64_t histogram_percentile(const histogram *h, double q);
+int init_metrics(metrics *m);
+int metrics_join(metrics *m, const char *role);
+void metrics_leave(void);
+bool metrics_on(void);
+void metrics_record(metric_stage stage, uint64_t ns);
+void metrics_busy(uint64_t ns);
+void metrics_done(uint64_t now);
+int write_metrics(metrics *m, FILE *out);
+int de_init_metrics(metrics *m);
+
+#endif
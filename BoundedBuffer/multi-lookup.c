@@ -1,154 +1,1145 @@
+#define _GNU_SOURCE // cpu_set_t, see placement.h
 #include "multi-lookup.h"
 #include "shared_array.h"
-#include "util.h"
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <string.h>
 #include <ctype.h>
 #include <sys/time.h>
+#include <time.h>
+#include <stdint.h>
+#include <signal.h>
+
+#define USAGE "Usage: ./multi-lookup [-q <queue capacity>] [-c <cache ttl seconds>] [-a <queries in flight per resolver>] [-n <name server>] [-b system|hosts:<file>|sim[:<options>]] [-m] [-k <chunk size KiB>] [-s -|<named pipe>|unix:<socket>|shm:<name>] [-o <reorder window> [-O wait|skip]] [-j <metrics report>] [-T <deadline ms>] [-R <retries>] [-H] [-P <cache file>[,<slots>]] [-p <requester cpus>] [-r <resolver cpus>] [-L] [-S <shards>] [-D exact|bloom[,count]] [-X <shm name>] [-W] <# requesters> <# resolvers | min:max> <requester log> <resolver log> [ <data file> ... ]"
+
+/*
+Records n hostnames in the requester log and copies them into the
+shared memory fifo of -X, where resolver processes take them (see
+shm_fifo.h). The records go straight back to the pool.
+*/
+static void export_hosts(req_arg_struct *args, req_batch *b, void **items, int n)
+{
+    for (int done = 0; done < n; done += REQ_BATCH_SIZE)
+    {
+        int count = n - done < REQ_BATCH_SIZE ? n - done : REQ_BATCH_SIZE;
+        const char *names[REQ_BATCH_SIZE];
+        int lens[REQ_BATCH_SIZE];
+
+        for (int i = 0; i < count; i++)
+        {
+            host_rec *h = items[done + i];
+            names[i] = h->name;
+            lens[i] = h->len;
+            log_printf(&b->log, "Added %.*s for resolution\n", h->len, h->name);
+        }
+
+        if (shm_put_n(args->exported, names, lens, count) == FIFO_CLOSED)
+        {
+            pthread_mutex_lock(args->err_lock);
+            fprintf(stderr, "The shared memory fifo was closed, %d hostnames were dropped\n", count);
+            pthread_mutex_unlock(args->err_lock);
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            pool_free(args->names, items[done + i]);
+        }
+    }
+}
+
+/*
+Records n hostnames in the requester log and hands them to the shared
+array with a single en_q_n(), or with a sharded array one per shard
+and pass of shard_put_n(). With ordered output they are numbered
+first.
+
+The log is written first, once enqueued a hostname may be resolved
+and returned to the pool by a resolver at any time. For the same
+reason the mapped file the names point into gains its references
+before they are enqueued.
+*/
+static void hand_over(req_arg_struct *args, req_batch *b, void **items, int n)
+{
+    if (n == 0)
+    {
+        return;
+    }
+
+    if (args->exported != NULL)
+    {
+        export_hosts(args, b, items, n);
+        return;
+    }
+
+    if (b->src != NULL)
+    {
+        hold_input(b->src, n);
+    }
+
+    uint64_t seq = args->reorder != NULL ? reorder_claim(args->reorder, n) : 0;
+    uint64_t now = metrics_on() ? metrics_now() : 0;
+    for (int i = 0; i < n; i++)
+    {
+        host_rec *h = items[i];
+        h->seq = seq + i;
+        if (metrics_on())
+        {
+            metrics_record(STAGE_PARSE, now - h->parsed_ns);
+            h->enqueued_ns = now;
+        }
+        log_printf(&b->log, "Added %.*s for resolution\n", h->len, h->name);
+    }
+
+    if (args->shared_array->num_shards == 1)
+    {
+        shard_put_n(args->shared_array, items, NULL, n);
+        return;
+    }
+
+    // route by the hash the result cache uses, resolvers of a shard then share cache shards too
+    for (int done = 0; done < n; done += REQ_BATCH_SIZE)
+    {
+        int count = n - done < REQ_BATCH_SIZE ? n - done : REQ_BATCH_SIZE;
+        uint64_t keys[REQ_BATCH_SIZE];
+
+        for (int i = 0; i < count; i++)
+        {
+            host_rec *h = items[done + i];
+            keys[i] = hash_name_n(h->name, h->len);
+        }
+        shard_put_n(args->shared_array, items + done, keys, count);
+    }
+}
+
+/*
+Hands the batch to the shared array, or while the requester is
+holding hostnames back, adds it to those held.
+*/
+static void enqueue_batch(req_arg_struct *args, req_batch *b)
+{
+    if (b->holding && b->count > 0)
+    {
+        if (b->num_held + b->count > b->held_cap)
+        {
+            int cap = b->held_cap > 0 ? 2 * b->held_cap : 4 * REQ_BATCH_SIZE;
+            void **held = realloc(b->held, cap * sizeof(void *));
+            if (held == NULL)
+            {
+                perror("Unable to hold back hostnames");
+                exit(EXIT_FAILURE);
+            }
+            b->held = held;
+            b->held_cap = cap;
+        }
+
+        memcpy(b->held + b->num_held, b->items, b->count * sizeof(void *));
+        b->num_held += b->count;
+    }
+    else
+    {
+        hand_over(args, b, b->items, b->count);
+    }
+
+    b->count = 0;
+}
+
+/*
+Hands over the hostnames of a chunk held back for ordered output,
+after those of every earlier chunk.
+*/
+static void release_held(req_arg_struct *args, req_batch *b, const input_chunk *chunk)
+{
+    reorder_begin(args->reorder, chunk->index);
+
+    for (int i = 0; i < b->num_held; i += REQ_BATCH_SIZE)
+    {
+        int n = b->num_held - i < REQ_BATCH_SIZE ? b->num_held - i : REQ_BATCH_SIZE;
+        hand_over(args, b, b->held + i, n);
+    }
+    b->num_held = 0;
+
+    reorder_end(args->reorder);
+}
+
+/*
+Adds one hostname found by a requester to its batch, handing the
+batch over once it is full. Names that are too long are reported
+and skipped, and with -D so are names seen before.
+
+The name is len bytes at name, not NUL terminated. If src is not
+NULL the name lies in that mapped file and the record only points
+at it, otherwise it is copied into the record.
+*/
+static void add_host(req_arg_struct *args, req_batch *b, const char *name, int len, input_file *src)
+{
+    if (len >= MAX_NAME_LENGTH)
+    {
+        pthread_mutex_lock(args->out_lock);
+        printf("Skipping %.*s: Address name length must not exceed %d\n", len, name, MAX_NAME_LENGTH);
+        pthread_mutex_unlock(args->out_lock);
+        log_printf(&b->log, "Skipping %.*s: Address name length must not exceed %d\n", len, name, MAX_NAME_LENGTH);
+        return;
+    }
+
+    if (args->dedup != NULL && dedup_seen(args->dedup, name, len))
+    {
+        return;
+    }
+
+    host_rec *h = pool_alloc(args->names, sizeof(host_rec) + (src != NULL ? 0 : len + 1));
+    if (h == NULL)
+    {
+        pthread_mutex_lock(args->err_lock);
+        fprintf(stderr, "Unable to allocate %.*s, skipping it\n", len, name);
+        pthread_mutex_unlock(args->err_lock);
+        return;
+    }
+    if (metrics_on())
+    {
+        h->parsed_ns = metrics_now();
+    }
+    h->len = len;
+    h->src = src;
+    h->reason = NULL;
+    if (src != NULL)
+    {
+        h->name = name;
+    }
+    else
+    {
+        memcpy(h->text, name, len);
+        h->text[len] = '\0';
+        h->name = h->text;
+    }
+
+    b->src = src;
+    b->items[b->count++] = h;
+    if (b->count == REQ_BATCH_SIZE)
+    {
+        enqueue_batch(args, b);
+    }
+}
+
+/*
+Reads the lines of a chunk with getline(), copying each hostname
+into a record of its own.
+
+Returns 0 on success, -1 if the file could not be opened.
+*/
+static int parse_stream(req_arg_struct *args, const input_chunk *chunk, req_batch *b)
+{
+    FILE *data_file = fopen(chunk->path, "r");
+    char *line = NULL; // lineptr buffer passed to getline()  -- dynamically modified in getline
+    size_t len = 0;    // length of lineptr buffer -- dynamically modified in getline()
+    ssize_t read;      // length of bytes read by getline()
+    off_t pos = chunk->lo;
+
+    if (data_file == NULL)
+    {
+        return -1;
+    }
+
+    // the line running into the chunk belongs to the previous one, reading from the
+    // byte before lo consumes either it or just the newline that ends it
+    if (chunk->lo > 0)
+    {
+        fseeko(data_file, chunk->lo - 1, SEEK_SET);
+        read = getline(&line, &len, data_file);
+        pos = read == -1 ? chunk->hi : chunk->lo - 1 + read;
+    }
+
+    // while lines start inside the chunk and getline() returns a valid char*
+    while (pos < chunk->hi && (read = getline(&line, &len, data_file)) != -1)
+    {
+        pos += read;
+        if (read > 0 && line[read - 1] == '\n') // the last line may lack a newline
+        {
+            read--;
+        }
+
+        add_host(args, b, line, read, NULL);
+    }
+
+    // don't hold the tail of a chunk back while the next one is claimed
+    enqueue_batch(args, b);
+
+    free(line);
+    fclose(data_file);
+
+    return 0;
+}
+
+/*
+Finds the lines of a chunk of a mapped file with memchr(), which glibc
+implements with vector instructions. Hostnames are handed over as
+slices of the mapping, which stays mapped until the last of them has
+been resolved.
+*/
+static void parse_mapped(req_arg_struct *args, const input_chunk *chunk, req_batch *b)
+{
+    input_file *f = chunk->map;
+    const char *p = f->data + chunk->lo;
+    const char *last = f->data + chunk->hi; // lines must start before this
+    const char *end = f->data + f->size;
+
+    // skip the line running into the chunk, the previous one parses it
+    if (chunk->lo > 0 && p[-1] != '\n')
+    {
+        const char *nl = memchr(p, '\n', end - p);
+        p = nl != NULL ? nl + 1 : end;
+    }
+
+    while (p < last)
+    {
+        const char *nl = memchr(p, '\n', end - p);
+        const char *stop = nl != NULL ? nl : end; // the last line may lack a newline
+
+        add_host(args, b, p, stop - p, f);
+        p = stop + 1;
+    }
+
+    enqueue_batch(args, b);
+}
 
 /*
 PRODUCER FUNCTION
 
 Expects as argument a struct containing a pointer to a queue (fifo struct, see shared_array.h)
-that already contains all the files to parse for hostnames, a pointer to a separate queue
-used to store all hostnames themselves, and a file pointer to a resolution log file
+that already contains every chunk of the data files to parse for hostnames (see input.h),
+a pointer to a separate queue used to store all hostnames themselves, and a file pointer
+to a resolution log file
 
-This function will iteratively parse all supplied files line by line and enqueue
-the hostname present on a line into a shared array. Continues until all files
-have been parsed, and then exits.
+This function will iteratively claim chunks and parse them line by line, enqueueing
+the hostname present on a line into a shared array. Large files are cut into many chunks,
+so all requesters share the work of a single file and one that finishes early simply
+claims the next chunk. Continues until all chunks have been parsed, and then exits.
 */
 void *service_file(void *arguments)
 {
     req_arg_struct *args = arguments;
-    int files_serviced = 0;
-    FILE *data_file;
-    char *line = NULL; // lineptr buffer passed to getline()  -- dynamically modified in getline
-    size_t len = 0;    // length of lineptr buffer -- dynamically modified in getline()
-    ssize_t read;      // length of bytes read by getline()
-    char *saved;       // used to enqueue an address at a unique memory address
+    int chunks_serviced = 0;
+    req_batch batch = {.count = 0}; // hostnames handed to the shared array in one en_q_n()
 
-    char *curr_data_file = de_q(args->data_files); // get first address name in queue
-    while (strcmp(curr_data_file, "empty") != 0)   // as long as the queue is not empty
+    init_log_stream(&batch.log, args->logs, args->req_log);
+    if (args->metrics != NULL)
     {
-        data_file = fopen(curr_data_file, "r");
-        if (data_file == NULL)
+        metrics_join(args->metrics, "requester");
+    }
+
+    void *curr_chunk;
+    while (de_q(args->data_files, &curr_chunk) == 0) // until the closed chunk queue is drained
+    {
+        input_chunk *chunk = curr_chunk;
+        int parsed = 0;
+        uint64_t claimed = metrics_on() ? metrics_now() : 0;
+
+        // with ordered output chunks are parsed in parallel but numbered in input order
+        batch.holding = args->reorder != NULL;
+
+        if (chunk->map != NULL)
+        {
+            parse_mapped(args, chunk, &batch);
+        }
+        else
+        {
+            parsed = parse_stream(args, chunk, &batch);
+        }
+
+        if (batch.holding)
+        {
+            release_held(args, &batch, chunk);
+            batch.holding = false;
+        }
+        if (chunk->map != NULL)
+        {
+            release_input(chunk->map); // the slices handed over hold their own references
+        }
+
+        if (parsed != 0)
         {
             pthread_mutex_lock(args->err_lock);
-            fprintf(stderr, "Unable to open file %s\n", curr_data_file);
+            fprintf(stderr, "Unable to open file %s\n", chunk->path);
             pthread_mutex_unlock(args->err_lock);
 
-            curr_data_file = de_q(args->data_files);
-            continue; // this is error is considered recoverable, don't use bad pointer, but try next file
-        }
+            continue; // this is error is considered recoverable, don't use bad pointer, but try next chunk
+        }
+
+        if (metrics_on())
+        {
+            metrics_busy(metrics_now() - claimed);
+        }
+        chunks_serviced++;
+    }
+
+    free(batch.held);
+    log_flush(&batch.log);
+    pool_thread_flush(args->names);
+
+    pthread_mutex_lock(args->out_lock);
+    printf("thread %lud serviced %d chunks\n", pthread_self(), chunks_serviced);
+    pthread_mutex_unlock(args->out_lock);
+
+    metrics_leave();
+    pthread_exit(NULL);
+}
+
+/*
+STREAMING PRODUCER FUNCTION
+
+Expects the same argument as service_file(), with source set instead of
+a queue of data files.
+
+Reads hostnames, one per line, from the streams of the source (see
+source.h) and hands them to the shared array as soon as each read
+completes rather than once a batch is full, so names trickling in are
+resolved without delay. Continues until the source runs out of streams
+or is stopped, and then exits.
+*/
+void *service_stream(void *arguments)
+{
+    req_arg_struct *args = arguments;
+    int streams_serviced = 0;
+    req_batch batch = {.count = 0}; // hostnames handed to the shared array in one en_q_n()
+    char *buf = malloc(STREAM_BUF_SIZE);
+    int fd;
+
+    init_log_stream(&batch.log, args->logs, args->req_log);
+    if (args->metrics != NULL)
+    {
+        metrics_join(args->metrics, "requester");
+    }
+
+    while (buf != NULL && (fd = next_stream(args->source)) >= 0)
+    {
+        size_t used = 0;       // bytes of an incomplete line at the start of buf
+        bool discarding = false; // inside a line too long for buf, drop it up to its newline
+        ssize_t read;
+
+        while ((read = read_stream(args->source, fd, buf + used, STREAM_BUF_SIZE - used)) > 0)
+        {
+            uint64_t arrived = metrics_on() ? metrics_now() : 0;
+            char *p = buf;
+            char *end = buf + used + read;
+            char *nl;
+
+            while ((nl = memchr(p, '\n', end - p)) != NULL)
+            {
+                if (!discarding)
+                {
+                    add_host(args, &batch, p, nl - p, NULL);
+                }
+                discarding = false;
+                p = nl + 1;
+            }
+
+            used = end - p;
+            if (used == STREAM_BUF_SIZE) // no newline in sight, report the line once
+            {
+                if (!discarding)
+                {
+                    add_host(args, &batch, buf, MAX_NAME_LENGTH, NULL);
+                }
+                discarding = true;
+                used = 0;
+            }
+            memmove(buf, p, used);
+
+            enqueue_batch(args, &batch);
+            log_flush(&batch.log);
+            if (metrics_on())
+            {
+                metrics_busy(metrics_now() - arrived);
+            }
+        }
+
+        if (used > 0 && !discarding) // the last line may lack a newline
+        {
+            add_host(args, &batch, buf, used, NULL);
+            enqueue_batch(args, &batch);
+        }
+
+        end_stream(args->source, fd);
+        streams_serviced++;
+    }
+
+    free(buf);
+    log_flush(&batch.log);
+    pool_thread_flush(args->names);
+
+    pthread_mutex_lock(args->out_lock);
+    printf("thread %lud serviced %d streams\n", pthread_self(), streams_serviced);
+    pthread_mutex_unlock(args->out_lock);
+
+    metrics_leave();
+    pthread_exit(NULL);
+}
+
+/*
+Copies the name of a hostname record into buf, which must hold
+MAX_NAME_LENGTH bytes, and NUL terminates it.
+*/
+static void copy_name(const host_rec *h, char *buf)
+{
+    memcpy(buf, h->name, h->len);
+    buf[h->len] = '\0';
+}
+
+/*
+Returns a hostname record to the pool once it has been resolved,
+and drops its reference on the mapped file it points into.
+*/
+static void release_host(res_arg_struct *args, host_rec *h)
+{
+    if (h->src != NULL)
+    {
+        release_input(h->src);
+    }
+
+    pool_free(args->names, h);
+}
+
+/*
+Asks the resolver backend for one hostname, through the attempt
+pool when lookups have a deadline, retries or hedging.
+*/
+static int query_backend(res_arg_struct *args, char *name, char *ip_addr)
+{
+    if (args->attempts != NULL)
+    {
+        return attempt_lookup(args->attempts, name, ip_addr, MAX_IP_LENGTH);
+    }
+
+    return resolver_lookup(args->resolver, name, ip_addr, MAX_IP_LENGTH);
+}
+
+/*
+Resolves one hostname through the backend, answering from the cache
+file when one is open. Results the backend gave a final answer for
+are stored in the file, timeouts and retry limits are not.
+*/
+static int query_stored(res_arg_struct *args, char *name, char *ip_addr)
+{
+    if (args->store == NULL)
+    {
+        return query_backend(args, name, ip_addr);
+    }
+
+    switch (disk_cache_lookup(args->store, name, ip_addr, MAX_IP_LENGTH))
+    {
+    case CACHE_RESOLVED:
+        return 0;
+    case CACHE_NOT_RESOLVED:
+        return -1;
+    }
+
+    int lookup_res = query_backend(args, name, ip_addr);
+    if (lookup_res == RESOLVER_SUCCESS || lookup_res == RESOLVER_FAILURE)
+    {
+        disk_cache_store(args->store, name, lookup_res == RESOLVER_SUCCESS ? ip_addr : NULL);
+    }
+
+    return lookup_res;
+}
+
+/*
+Resolves one hostname into ip_addr, answering from the result cache
+when one is enabled. Concurrent lookups of the same name wait for
+the first one to finish. Failures the backend gave a final answer for
+are cached as well; timeouts and retry limits are not, like in the
+cache file, so the name is looked up again next time.
+
+Returns 0 if the name resolved, non-zero otherwise: a RESOLVER_ or
+ATTEMPT_ code, or -1 for a failure answered from the cache.
+*/
+static int lookup_name(res_arg_struct *args, char *name, char *ip_addr)
+{
+    if (args->cache == NULL)
+    {
+        return query_stored(args, name, ip_addr);
+    }
+
+    switch (cache_lookup(args->cache, name, ip_addr, MAX_IP_LENGTH))
+    {
+    case CACHE_RESOLVED:
+        return 0;
+    case CACHE_NOT_RESOLVED:
+        return -1;
+    }
+
+    int lookup_res = query_stored(args, name, ip_addr);
+    if (lookup_res == RESOLVER_SUCCESS || lookup_res == RESOLVER_FAILURE)
+    {
+        cache_fill(args->cache, name, lookup_res == RESOLVER_SUCCESS ? ip_addr : NULL);
+    }
+    else
+    {
+        cache_abandon(args->cache, name);
+    }
+
+    return lookup_res;
+}
+
+/*
+Writes the outcome of a lookup to the resolver log, the address or
+NOT_RESOLVED if ip_addr is NULL, followed by the reason if known.
+*/
+static void log_result(log_stream *log, const char *name, const char *ip_addr, const char *reason)
+{
+    if (ip_addr != NULL)
+    {
+        log_printf(log, "%s, %s\n", name, ip_addr);
+    }
+    else if (reason != NULL)
+    {
+        log_printf(log, "%s, NOT_RESOLVED, %s\n", name, reason);
+    }
+    else
+    {
+        log_printf(log, "%s, NOT_RESOLVED\n", name);
+    }
+}
+
+/*
+Counts a finished lookup in the calling thread's metrics, from the
+times its lookup started and ended.
+*/
+static void record_lookup(host_rec *h, uint64_t started, uint64_t ended)
+{
+    metrics_record(STAGE_LOOKUP, ended - started);
+    metrics_record(STAGE_TOTAL, ended - h->parsed_ns);
+    metrics_done(ended);
+}
+
+/*
+Writes the outcome of a lookup to the resolver log and releases the
+hostname, or with ordered output passes both to the reorder buffer,
+which does so once the results before it have been written.
+*/
+static void finish_host(res_arg_struct *args, log_stream *log, host_rec *h, const char *name, const char *ip_addr)
+{
+    if (args->reorder != NULL)
+    {
+        reorder_put(args->reorder, h->seq, h, ip_addr);
+        return;
+    }
+
+    log_result(log, name, ip_addr, h->reason);
+    release_host(args, h);
+}
+
+/*
+Called by the reorder buffer, with its lock held, for each result
+in input order.
+*/
+static void write_ordered(void *context, void *item, const char *ip_addr)
+{
+    res_arg_struct *args = context;
+    char name[MAX_NAME_LENGTH];
+
+    copy_name(item, name);
+    log_result(args->ordered_log, name, ip_addr, ((host_rec *)item)->reason);
+    if (args->streaming)
+    {
+        log_flush(args->ordered_log); // emit results as they complete
+    }
+    release_host(args, item);
+}
+
+/*
+CONSUMER FUNCTION
+
+Expects as argument a struct containing a pointer to the shared array (queue) used to store address names
+and a pointer to a requester log file.
+
+Dequeues address names from the shared array and passes these hostnames to the resolver
+backend selected on the command line (see resolver.h), unless the result cache already
+holds a result for the name
+
+If the DNS lookup was successful, writes the original host address name and ip address to the resolver log file.
+If the lookup failed, writes the original host address name and "NOT RESOLVED" to the resolver log file.
+
+Continues until the requesters have closed the queue and it has been
+drained, and then exits.
+*/
+void *resolve_addr(void *arguments)
+{
+    res_arg_struct *args = arguments;
+    int num_hosts = 0;
+    void *batch[RES_BATCH_SIZE];
+    int batched;
+    bool retired = false;
+    int home = shard_home(args->shared_array);
+    log_stream log; // this thread's lines of the resolver log
+
+    init_log_stream(&log, args->logs, args->res_log);
+    if (args->metrics != NULL)
+    {
+        metrics_join(args->metrics, "resolver");
+    }
+
+    // until requesters close the queue and it drains, or the pool shrinks
+    while (!retired && (batched = shard_take(args->shared_array, home, batch, RES_BATCH_SIZE)) != FIFO_CLOSED)
+    {
+        uint64_t taken = metrics_on() ? metrics_now() : 0;
+
+        for (int i = 0; i < batched; i++)
+        {
+            char curr_address[MAX_NAME_LENGTH];
+            char ip_addr[MAX_IP_LENGTH];
+
+            if (batch[i] == NULL) // sent by scale_resolvers(), finish the batch and exit
+            {
+                __atomic_sub_fetch(&args->retiring, 1, __ATOMIC_RELAXED);
+                retired = true;
+                continue;
+            }
+
+            copy_name(batch[i], curr_address);
+            uint64_t started = metrics_now();
+            int lookup_res = lookup_name(args, curr_address, ip_addr);
+            uint64_t ended = metrics_now();
+            __atomic_add_fetch(&args->lookup_ns, ended - started, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&args->lookups, 1, __ATOMIC_RELAXED);
+
+            if (metrics_on())
+            {
+                host_rec *h = batch[i];
+                metrics_record(STAGE_QUEUE, taken - h->enqueued_ns);
+                metrics_record(STAGE_DISPATCH, started - taken);
+                record_lookup(h, started, ended);
+                metrics_busy(ended - started);
+            }
+
+            ((host_rec *)batch[i])->reason = attempt_reason(lookup_res);
+            finish_host(args, &log, batch[i], curr_address, lookup_res == 0 ? ip_addr : NULL);
+            num_hosts++;
+        }
+
+        if (args->streaming)
+        {
+            log_flush(&log); // emit results as they complete
+        }
+    }
+
+    log_flush(&log);
+    pool_thread_flush(args->names);
+
+    pthread_mutex_lock(args->out_lock);
+    printf("thread %lud resolved %d hostnames\n", pthread_self(), num_hosts);
+    pthread_mutex_unlock(args->out_lock);
+
+    metrics_leave();
+    pthread_exit(NULL);
+}
+
+/*
+Logs and releases a hostname whose lookup by resolve_addr_async()
+finished. If the thread claimed the name in the result cache
+(owner), the outcome is stored there as well unless it is not final,
+e.g. the server never replied; the claim is then given up.
+*/
+static void finish_async(res_arg_struct *args, log_stream *log, host_rec *h, const char *ip_addr, bool owner, bool final)
+{
+    char name[MAX_NAME_LENGTH];
+
+    if (metrics_on())
+    {
+        record_lookup(h, h->started_ns, metrics_now());
+    }
+
+    copy_name(h, name);
+    if (owner && final)
+    {
+        cache_fill(args->cache, name, ip_addr);
+    }
+    else if (owner)
+    {
+        cache_abandon(args->cache, name);
+    }
+
+    finish_host(args, log, h, name, ip_addr);
+}
+
+/*
+Starts the lookup of one hostname for resolve_addr_async(). Names found
+in the result cache or the cache file are finished immediately, the
+others are sent to the DNS server.
+
+A name another thread is already resolving is sent anyway rather than
+waited for, this thread must keep serving the lookups it has in flight.
+
+Returns 1 if the name was finished, 0 if its query is in flight.
+*/
+static int start_async(res_arg_struct *args, log_stream *log, dns_client *client, host_rec *h)
+{
+    char name[MAX_NAME_LENGTH];
+    char ip_addr[MAX_IP_LENGTH];
+    bool owner = false;
+
+    copy_name(h, name);
+
+    if (args->cache != NULL)
+    {
+        switch (cache_try_lookup(args->cache, name, ip_addr, MAX_IP_LENGTH))
+        {
+        case CACHE_RESOLVED:
+            finish_async(args, log, h, ip_addr, false, true);
+            return 1;
+        case CACHE_NOT_RESOLVED:
+            finish_async(args, log, h, NULL, false, true);
+            return 1;
+        case CACHE_MISS:
+            owner = true;
+            break;
+        }
+    }
+
+    if (args->store != NULL)
+    {
+        switch (disk_cache_lookup(args->store, name, ip_addr, MAX_IP_LENGTH))
+        {
+        case CACHE_RESOLVED:
+            finish_async(args, log, h, ip_addr, owner, true);
+            return 1;
+        case CACHE_NOT_RESOLVED:
+            finish_async(args, log, h, NULL, owner, true);
+            return 1;
+        }
+    }
+
+    if (dns_submit(client, name, h, owner) != 0) // not a valid DNS name
+    {
+        finish_async(args, log, h, NULL, owner, true);
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ASYNCHRONOUS CONSUMER FUNCTION
+
+Expects the same argument as resolve_addr(), with async_depth set.
+
+Keeps up to async_depth DNS queries in flight through a non-blocking client (see
+async_dns.h) instead of blocking in the resolver backend for one name at a time, and writes
+each result to the resolver log as its answer arrives.
+
+Continues until the requesters have closed the queue, it has been drained
+and every answer has arrived, and then exits.
+*/
+void *resolve_addr_async(void *arguments)
+{
+    res_arg_struct *args = arguments;
+    int num_hosts = 0;
+    bool closed = false;
+    int home = shard_home(args->shared_array);
+    dns_client client;
+    void *batch[ASYNC_BATCH_SIZE];
+    dns_result results[ASYNC_BATCH_SIZE];
+    log_stream log; // this thread's lines of the resolver log
+
+    init_log_stream(&log, args->logs, args->res_log);
+    if (args->metrics != NULL)
+    {
+        metrics_join(args->metrics, "resolver");
+    }
+
+    if (init_dns_client(&client, args->nameserver, args->async_depth) != 0)
+    {
+        pthread_mutex_lock(args->err_lock);
+        fprintf(stderr, "Unable to reach name server %s\n", args->nameserver != NULL ? args->nameserver : "from /etc/resolv.conf");
+        pthread_mutex_unlock(args->err_lock);
+
+        metrics_leave();
+        pthread_exit(NULL);
+    }
+
+    while (!closed || client.outstanding > 0)
+    {
+        int room = client.depth - client.outstanding;
+
+        if (!closed && room > 0)
+        {
+            int max = room < ASYNC_BATCH_SIZE ? room : ASYNC_BATCH_SIZE;
+            int batched = client.outstanding == 0 ? shard_take(args->shared_array, home, batch, max)
+                                                  : shard_try_take(args->shared_array, home, batch, max);
+
+            if (batched == FIFO_CLOSED)
+            {
+                closed = true;
+            }
+
+            uint64_t taken = metrics_on() ? metrics_now() : 0;
+            for (int i = 0; i < batched; i++)
+            {
+                host_rec *h = batch[i];
+                if (h == NULL) // sent by scale_resolvers(), finish what is in flight and exit
+                {
+                    __atomic_sub_fetch(&args->retiring, 1, __ATOMIC_RELAXED);
+                    closed = true;
+                    continue;
+                }
+                if (metrics_on())
+                {
+                    metrics_record(STAGE_QUEUE, taken - h->enqueued_ns);
+                    h->started_ns = taken;
+                }
+                num_hosts += start_async(args, &log, &client, h);
+            }
+            if (metrics_on())
+            {
+                metrics_busy(metrics_now() - taken);
+            }
+
+            if (batched == max)
+            {
+                continue; // the queue may hold more, fill the window first
+            }
+        }
+
+        // wake up now and then to take newly queued names while waiting for answers
+        int completed = dns_poll(&client, closed || room == 0 ? -1 : ASYNC_POLL_MS, results, ASYNC_BATCH_SIZE);
+        uint64_t polled = metrics_on() ? metrics_now() : 0;
+        for (int i = 0; i < completed; i++)
+        {
+            bool final = results[i].status != DNS_NO_REPLY; // a server that never replied said nothing about the name
+            const char *ip_addr = results[i].status == DNS_ANSWERED ? results[i].ip : NULL;
+            if (args->store != NULL && final)
+            {
+                char name[MAX_NAME_LENGTH];
+                copy_name(results[i].context, name);
+                disk_cache_store(args->store, name, ip_addr);
+            }
+            finish_async(args, &log, results[i].context, ip_addr, results[i].tag != 0, final);
+            num_hosts++;
+        }
+        if (metrics_on())
+        {
+            metrics_busy(metrics_now() - polled);
+        }
+
+        if (args->streaming)
+        {
+            log_flush(&log); // emit results as they complete
+        }
+    }
+
+    de_init_dns_client(&client);
+    log_flush(&log);
+    pool_thread_flush(args->names);
+
+    pthread_mutex_lock(args->out_lock);
+    printf("thread %lud resolved %d hostnames\n", pthread_self(), num_hosts);
+    pthread_mutex_unlock(args->out_lock);
+
+    metrics_leave();
+    pthread_exit(NULL);
+}
+
+/*
+Cleanup handler of a resolver thread, runs when it exits.
+*/
+static void resolver_exited(void *arg)
+{
+    resolver_pool *p = arg;
+
+    pthread_mutex_lock(&p->lock);
+    p->live--;
+    pthread_cond_broadcast(&p->changed);
+    pthread_mutex_unlock(&p->lock);
+}
+
+/*
+Start routine of every resolver thread, runs the pool's resolver
+function and keeps the count of live threads.
+*/
+static void *run_resolver(void *arg)
+{
+    resolver_pool *p = arg;
+
+    pthread_cleanup_push(&resolver_exited, p); // resolvers leave through pthread_exit()
+    p->routine(p->args);
+    pthread_cleanup_pop(1);
 
-        // while getline() returns a valid char*
-        while ((read = getline(&line, &len, data_file)) != -1)
-        {
-            if (read <= MAX_NAME_LENGTH)
-            {
-                // remove trailing newline
-                for (int i = 0;; i++)
-                {
-                    if (line[i] == '\n')
-                    {
-                        line[i] = '\0';
-                        break;
-                    }
-                }
+    return NULL;
+}
 
-                saved = malloc(MAX_NAME_LENGTH);
-                strcpy(saved, line);
+/*
+Starts n more resolver threads. Must be called with the pool locked.
 
-                en_q(args->shared_array, saved); // enqueue the address as char *saved
+Returns the number of threads started.
+*/
+static int add_resolvers(resolver_pool *p, int n)
+{
+    pthread_attr_t attr;
+    pthread_t thread;
+    int started = 0;
 
-                pthread_mutex_lock(args->out_lock);
-                fprintf(args->req_log, "Added %s for resolution\n", saved);
-                pthread_mutex_unlock(args->out_lock);
-            }
-            else
-            {
-                pthread_mutex_lock(args->out_lock);
-                printf("Skipping %s: Address name length must not exceed %d\n", line, MAX_NAME_LENGTH);
-                fprintf(args->req_log, "Skipping %s: Address name length must not exceed %d\n", line, MAX_NAME_LENGTH);
-                pthread_mutex_unlock(args->out_lock);
-            }
-        }
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED); // waited for through live
+    place_thread(&attr, p->cpus);
 
-        fclose(data_file);
-        files_serviced++;
-        curr_data_file = de_q(args->data_files); // get next file
+    while (started < n && pthread_create(&thread, &attr, &run_resolver, p) == 0)
+    {
+        p->live++;
+        started++;
+    }
+    if (p->live > p->peak)
+    {
+        p->peak = p->live;
     }
 
-    free(line);
-
-    pthread_mutex_lock(args->out_lock);
-    printf("thread %lud serviced %d files\n", pthread_self(), files_serviced);
-    pthread_mutex_unlock(args->out_lock);
-
-    pthread_exit(NULL);
+    pthread_attr_destroy(&attr);
+    return started;
 }
 
 /*
-CONSUMER FUNCTION
+Start routine of the thread resizing an autoscaled resolver pool.
 
-Expects as argument a struct containing a pointer to the shared array (queue) used to store address names
-and a pointer to a requester log file.
+Every SCALE_INTERVAL_MS it estimates how long the running resolvers
+need to clear the hostname queue, from its depth and the average
+lookup latency over the interval. Beyond SCALE_TARGET_MS the pool
+grows by half. Until a lookup has completed there is no latency to
+go by, and a queue more than half full counts as falling behind.
 
-Dequeues address names from the shared array and passes these hostnames to the dnslookup()
-function declared in util.h and defined in util.c
+The estimate can never exceed the queue capacity times the latency,
+so with fast lookups and a small queue it stays below the target
+however far behind the resolvers are. A queue that has stayed at
+least three quarters full for SCALE_FULL_TICKS intervals therefore
+grows the pool as well, the requesters are waiting on it.
 
-If the DNS lookup was successful, writes the original host address name and ip address to the resolver log file.
-If the lookup failed, writes the original host address name and "NOT RESOLVED" to the resolver log file.
+Once the queue has stayed empty for SCALE_IDLE_TICKS intervals one
+resolver is retired by queueing a NULL hostname, which the resolver
+that takes it reads as a request to exit.
 
-Continues until the queue is empty, and then exits.
+Continues until stop is set, and then exits.
 */
-void *resolve_addr(void *arguments)
+static void *scale_resolvers(void *arg)
 {
-    res_arg_struct *args = arguments;
-    int num_hosts = 0;
-    char *curr_address = de_q(args->shared_array);
+    resolver_pool *p = arg;
+    res_arg_struct *args = p->args;
+    uint64_t last_ns = 0;
+    uint64_t last_lookups = 0;
+    uint64_t latency = 0; // ns per lookup over the last interval that had any
+    int idle = 0;
+    int full = 0;         // intervals in a row the queue has been at least three quarters full
+    int retired = 0;      // resolvers retired so far, their NULL hostnames go to the shards in turn
 
-    while (strcmp(curr_address, "empty") != 0)
+    pthread_mutex_lock(&p->lock);
+    while (!p->stop)
     {
-        char ip_addr[MAX_IP_LENGTH];
-        int lookup_res = dnslookup(curr_address, ip_addr, MAX_IP_LENGTH);
+        struct timespec wake;
+        clock_gettime(CLOCK_REALTIME, &wake);
+        wake.tv_nsec += SCALE_INTERVAL_MS * 1000000L;
+        wake.tv_sec += wake.tv_nsec / 1000000000L;
+        wake.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&p->changed, &p->lock, &wake);
+        if (p->stop)
+        {
+            break;
+        }
+
+        uint64_t total_ns = __atomic_load_n(&args->lookup_ns, __ATOMIC_RELAXED);
+        uint64_t lookups = __atomic_load_n(&args->lookups, __ATOMIC_RELAXED);
+        if (lookups > last_lookups)
+        {
+            latency = (total_ns - last_ns) / (lookups - last_lookups);
+        }
+        last_ns = total_ns;
+        last_lookups = lookups;
 
-        if (lookup_res == 0)
+        int depth = shard_size(args->shared_array);
+        int active = p->live - __atomic_load_n(&args->retiring, __ATOMIC_RELAXED);
+        if (active < 1)
         {
-            pthread_mutex_lock(args->out_lock);
-            fprintf(args->res_log, "%s, %s\n", curr_address, ip_addr);
-            pthread_mutex_unlock(args->out_lock);
+            active = 1;
         }
+        uint64_t backlog_ms = latency * depth / active / 1000000;
 
+        // a full queue caps the backlog estimate, so it counts as falling behind on its own
+        if ((size_t)depth >= args->shared_array->capacity / 4 * 3)
+        {
+            full++;
+        }
         else
         {
-            pthread_mutex_lock(args->out_lock);
-            fprintf(args->res_log, "%s, NOT_RESOLVED\n", curr_address);
-            pthread_mutex_unlock(args->out_lock);
+            full = 0;
         }
 
-        free(curr_address);
-        num_hosts++;
-        curr_address = de_q(args->shared_array);
+        if (active < p->max && (backlog_ms > SCALE_TARGET_MS || full >= SCALE_FULL_TICKS ||
+                                (latency == 0 && (size_t)depth > args->shared_array->capacity / 2)))
+        {
+            int grow = active / 2 > 0 ? active / 2 : 1;
+            add_resolvers(p, grow < p->max - active ? grow : p->max - active);
+            idle = 0;
+            full = 0;
+        }
+        else if (depth == 0 && active > p->min && ++idle >= SCALE_IDLE_TICKS)
+        {
+            __atomic_add_fetch(&args->retiring, 1, __ATOMIC_RELAXED);
+            pthread_mutex_unlock(&p->lock); // resolvers take the lock to exit, don't hold it if en_q waits
+            shard_put(args->shared_array, retired++, NULL);
+            pthread_mutex_lock(&p->lock);
+            idle = 0;
+        }
+        else if (depth > 0)
+        {
+            idle = 0;
+        }
     }
+    pthread_mutex_unlock(&p->lock);
 
-    pthread_mutex_lock(args->out_lock);
-    printf("thread %lud resolved %d hostnames\n", pthread_self(), num_hosts);
-    pthread_mutex_unlock(args->out_lock);
+    return NULL;
+}
 
-    pthread_exit(NULL);
+/*
+The source read with -s, stopped by SIGINT and SIGTERM.
+*/
+static input_source *running_source;
+
+static void stop_running(int sig)
+{
+    (void)sig;
+    stop_source(running_source);
 }
 
 int main(int argc, char *argv[])
 {
-    // structs for measuring runtime
-    struct timeval tv_start;
-    struct timeval tv_end;
+    // start of the run, for measuring runtime
+    uint64_t start_ns;
 
     // variables local to main() declared
     int num_req = 0; // number of requester threads
-    int num_res = 0; // number of resolver threads
+    int num_res = 0; // number of resolver threads, the most with an autoscaled pool
+    int min_res = 0; // fewest resolver threads, less than num_res for an autoscaled pool
+    int queue_size = BUFFER_SIZE; // capacity of the hostname queue
+    int cache_ttl = 0;            // seconds results stay cached, 0 disables the cache
+    int async_depth = 0;          // queries in flight per resolver, 0 for the blocking backend
+    char *nameserver = NULL;      // for async resolvers, NULL for /etc/resolv.conf
+    char *backend = "system";     // see init_resolver() in resolver.c
+    bool use_mmap = false;        // pass hostnames as slices of mapped data files
+    long chunk_kib = CHUNK_SIZE / 1024; // data files are parsed in chunks of this many KiB
+    char *stream_spec = NULL;     // read hostnames from this source instead of data files
+    int order_window = 0;         // results held back to write them in input order, 0 disables
+    reorder_policy order_policy = REORDER_WAIT;
+    char *report_path = NULL;     // write latency metrics here as JSON, NULL disables them
+    int deadline_ms = 0;          // lookups taking longer are given up as TIMEOUT, 0 for none
+    int retries = 0;              // times a temporary failure is tried again
+    bool hedge = false;           // start a second attempt of lookups slower than most
+    char *store_path = NULL;      // keep results in this file across runs, NULL disables it
+    long store_slots = DISK_CACHE_SLOTS; // slots of a new cache file
+    cpu_set_t req_cpus, res_cpus; // CPUs requesters and resolvers are pinned to
+    bool pin_req = false, pin_res = false;
+    bool share_l3 = false;        // keep requesters and resolvers on one L3 cache
+    int num_shards = 1;           // independent fifos the shared array is split into
+    bool use_dedup = false;       // recognize hostnames seen before
+    dedup_kind dedup_type = DEDUP_EXACT;
+    bool dedup_drop = true;       // drop them, or only count them
+    char *export_name = NULL;     // hand hostnames to resolver processes through this shm fifo
+    fifo_mode queue_mode = FIFO_LOCK_FREE; // FIFO_ADAPTIVE spins before threads sleep on the shared array
+    int opt;
 
     FILE *req; // points to requester log file
     FILE *res; // points to resolver log file
@@ -157,16 +1148,179 @@ int main(int argc, char *argv[])
     pthread_mutex_t stderr_lock, stdout_lock;
 
     // begin measuring runtime
-    gettimeofday(&tv_start, 0);
+    start_ns = metrics_now();
 
     // initialize synchronization mechanisms 
     pthread_mutex_init(&stderr_lock, NULL);
     pthread_mutex_init(&stdout_lock, NULL);
 
+    // parse options, which must precede the positional arguments
+    while ((opt = getopt(argc, argv, "+q:c:a:n:b:mk:s:o:O:j:T:R:HP:p:r:LS:D:X:W")) != -1)
+    {
+        switch (opt)
+        {
+        case 'q':
+            queue_size = atoi(optarg);
+            if (queue_size < 1 || queue_size > MAX_BUFFER_SIZE)
+            {
+                fprintf(stderr, "Queue capacity must be between 1 and %d\n", MAX_BUFFER_SIZE);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'c':
+            cache_ttl = atoi(optarg);
+            if (cache_ttl < 1)
+            {
+                fprintf(stderr, "Cache ttl must be at least 1 second\n");
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'a':
+            async_depth = atoi(optarg);
+            if (async_depth < 1 || async_depth > DNS_MAX_INFLIGHT)
+            {
+                fprintf(stderr, "Queries in flight must be between 1 and %d\n", DNS_MAX_INFLIGHT);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'n':
+            nameserver = optarg;
+            break;
+        case 'b':
+            backend = optarg;
+            break;
+        case 'm':
+            use_mmap = true;
+            break;
+        case 'k':
+            chunk_kib = atol(optarg);
+            if (chunk_kib < 1)
+            {
+                fprintf(stderr, "Chunk size must be at least 1 KiB\n");
+                return EXIT_FAILURE;
+            }
+            break;
+        case 's':
+            stream_spec = optarg;
+            break;
+        case 'j':
+            report_path = optarg;
+            break;
+        case 'o':
+            order_window = atoi(optarg);
+            if (order_window < REQ_BATCH_SIZE)
+            {
+                fprintf(stderr, "Reorder window must be at least %d\n", REQ_BATCH_SIZE);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'T':
+            deadline_ms = atoi(optarg);
+            if (deadline_ms < 1)
+            {
+                fprintf(stderr, "Lookup deadline must be at least 1 ms\n");
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'R':
+            retries = atoi(optarg);
+            if (retries < 0)
+            {
+                fprintf(stderr, "Retries must not be negative\n");
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'H':
+            hedge = true;
+            break;
+        case 'P':
+            store_path = optarg;
+            char *slots = strrchr(optarg, ',');
+            if (slots != NULL)
+            {
+                *slots = '\0';
+                store_slots = atol(slots + 1);
+                if (store_slots < 1 || (store_slots & (store_slots - 1)) != 0)
+                {
+                    fprintf(stderr, "Cache file slots must be a power of two\n");
+                    return EXIT_FAILURE;
+                }
+            }
+            break;
+        case 'p':
+        case 'r':
+            if (parse_cpus(optarg, opt == 'p' ? &req_cpus : &res_cpus) != 0)
+            {
+                fprintf(stderr, "CPU list must look like 0-3,8,10-11\n");
+                return EXIT_FAILURE;
+            }
+            pin_req |= opt == 'p';
+            pin_res |= opt == 'r';
+            break;
+        case 'L':
+            share_l3 = true;
+            break;
+        case 'S':
+            num_shards = atoi(optarg);
+            if (num_shards < 1 || num_shards > MAX_SHARDS)
+            {
+                fprintf(stderr, "Shards must be between 1 and %d\n", MAX_SHARDS);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'D':
+            use_dedup = true;
+            dedup_drop = strstr(optarg, ",count") == NULL;
+            if (strncmp(optarg, "exact", 5) == 0)
+            {
+                dedup_type = DEDUP_EXACT;
+            }
+            else if (strncmp(optarg, "bloom", 5) == 0)
+            {
+                dedup_type = DEDUP_BLOOM;
+            }
+            else
+            {
+                fprintf(stderr, "Duplicate filter must be exact or bloom\n");
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'X':
+            export_name = optarg;
+            break;
+        case 'W':
+            queue_mode = FIFO_ADAPTIVE;
+            break;
+        case 'O':
+            if (strcmp(optarg, "wait") == 0)
+            {
+                order_policy = REORDER_WAIT;
+            }
+            else if (strcmp(optarg, "skip") == 0)
+            {
+                order_policy = REORDER_SKIP;
+            }
+            else
+            {
+                fprintf(stderr, "Reorder policy must be wait or skip\n");
+                return EXIT_FAILURE;
+            }
+            break;
+        default:
+            puts(USAGE);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // drop the options so argv[1] is the number of requesters again
+    argv[optind - 1] = argv[0];
+    argc -= optind - 1;
+    argv += optind - 1;
+
     // if too few args passed
-    if (argc < 6)
+    if (argc < (stream_spec != NULL ? 5 : 6))
     {
-        puts("Usage: ./multi-lookup <# requesters> <# resolvers> <requester log> <resolver log> [ <data file> ... ]");
+        puts(USAGE);
         return EXIT_FAILURE;
     }
 
@@ -174,40 +1328,46 @@ int main(int argc, char *argv[])
     if (argv[1] != NULL)
     {
         int temp = atoi(argv[1]);
-        if (temp > 0 && temp <= MAX_REQUESTER_THREADS)
+        if (temp > 0)
         {
             num_req = temp;
         }
         else
         {
-            perror("Number of requester/resolver threads must be between 1 and 10");
+            fprintf(stderr, "Number of requester threads must be at least 1\n");
             return EXIT_FAILURE;
         }
     }
     else
     {
         perror("Invalid argument passed for number of requester threads");
-        puts("Usage: ./multi-lookup <# requesters> <# resolvers> <requester log> <resolver log> [ <data file> ... ]");
+        puts(USAGE);
         return EXIT_FAILURE;
     }
 
     if (argv[2] != NULL)
     {
-        int temp = atoi(argv[2]);
-        if (temp > 0 && temp <= MAX_RESOLVER_THREADS)
+        // either a fixed count or min:max for a pool resized with the load
+        int parsed = sscanf(argv[2], "%d:%d", &min_res, &num_res);
+        if (parsed == 1)
         {
-            num_res = temp;
+            num_res = min_res;
         }
-        else
+        if (parsed < 1 || min_res < (export_name != NULL ? 0 : 1) || num_res < min_res)
+        {
+            fprintf(stderr, "Number of resolver threads must be at least 1, or min:max with 1 <= min <= max\n");
+            return EXIT_FAILURE;
+        }
+        if (export_name != NULL && num_res > 0)
         {
-            perror("Number of requester/resolver threads must be between 1 and 10");
+            fprintf(stderr, "With -X hostnames are resolved by other processes, the number of resolver threads must be 0\n");
             return EXIT_FAILURE;
         }
     }
     else
     {
         perror("Invalid argument passed for number of resolver threads");
-        puts("Usage: ./multi-lookup <# requesters> <# resolvers> <requester log> <resolver log> [ <data file> ... ]");
+        puts(USAGE);
         return EXIT_FAILURE;
     }
 
@@ -242,41 +1402,270 @@ int main(int argc, char *argv[])
     }
 
     // check number of data files is within limits
-    if (argc - 5 > MAX_INPUT_FILES)
+    if (argc - 5 == 0 && stream_spec == NULL)
     {
-        perror("The maximum number of data files is 100");
+        perror("You must enter at least one data file");
         return EXIT_FAILURE;
     }
-    if (argc - 5 == 0)
+    if (argc - 5 > 0 && stream_spec != NULL)
     {
-        perror("You must enter at least one data file");
+        fprintf(stderr, "Data files cannot be combined with -s\n");
+        return EXIT_FAILURE;
+    }
+    if (use_dedup && stream_spec != NULL)
+    {
+        // the filter never forgets a name, a daemon would fill it up
+        fprintf(stderr, "The duplicate filter (-D) cannot be combined with -s\n");
         return EXIT_FAILURE;
     }
 
-    // create shared_array data structure for filenames
-    fifo files;
-    init_q(&files);
-    // use argc - 5 to determine how many files passed
+    // a daemon reads until its source runs dry or it is told to stop
+    input_source source;
+    if (stream_spec != NULL)
+    {
+        if (open_source(&source, stream_spec) != 0)
+        {
+            perror("Unable to open the hostname source");
+            return EXIT_FAILURE;
+        }
+
+        struct sigaction sa = {.sa_handler = &stop_running, .sa_flags = SA_RESTART};
+        sigemptyset(&sa.sa_mask);
+        running_source = &source;
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGTERM, &sa, NULL);
+    }
+
+    // cut every data file into chunks, use argc - 5 to determine how many files passed
+    input_chunk **file_chunks = calloc(argc - 4, sizeof(input_chunk *)); // one spare, not empty with -s
+    int *num_chunks = calloc(argc - 4, sizeof(int));
+    if (file_chunks == NULL || num_chunks == NULL)
+    {
+        perror("Unable to allocate the data file list");
+        return EXIT_FAILURE;
+    }
+    int total_chunks = 0;
+    size_t input_bytes = 0; // sizes the Bloom filter
     for (int i = 5; i < argc; i++)
     {
-        en_q(&files, argv[i]); // en_q each file (sync mechanisms defined in shared_array.c)
+        file_chunks[i - 5] = split_input(argv[i], (off_t)chunk_kib * 1024, use_mmap, &num_chunks[i - 5]);
+        if (file_chunks[i - 5] == NULL)
+        {
+            fprintf(stderr, "Unable to open file %s\n", argv[i]); // recoverable, try the next file
+            num_chunks[i - 5] = 0;
+        }
+        else
+        {
+            input_bytes += file_chunks[i - 5][num_chunks[i - 5] - 1].hi;
+        }
+        total_chunks += num_chunks[i - 5];
+    }
+
+    // create shared_array data structure for chunks
+    // sized to hold every chunk so enqueueing them never blocks
+    fifo files;
+    if (init_q(&files, total_chunks > 0 ? total_chunks : 1, FIFO_LOCK_FREE) != 0)
+    {
+        perror("Unable to allocate the chunk queue");
+        return EXIT_FAILURE;
+    }
+    uint64_t chunk_index = 0;
+    for (int i = 0; i < argc - 5; i++)
+    {
+        for (int j = 0; j < num_chunks[i]; j++)
+        {
+            file_chunks[i][j].index = chunk_index++;
+            en_q(&files, &file_chunks[i][j]); // en_q each chunk (sync mechanisms defined in shared_array.c)
+        }
+    }
+    close_q(&files); // no more chunks, requesters exit once they have all been taken
+
+    // with -L both pools are narrowed to the L3 cache of the first CPU they may use
+    if (share_l3)
+    {
+        cpu_set_t l3;
+        int cpu = pin_req ? first_cpu(&req_cpus) : pin_res ? first_cpu(&res_cpus) : sched_getcpu();
+
+        if (l3_cpus(cpu, &l3) != 0)
+        {
+            fprintf(stderr, "Unable to read the L3 cache topology of CPU %d\n", cpu);
+            return EXIT_FAILURE;
+        }
+        if (pin_req)
+        {
+            CPU_AND(&req_cpus, &req_cpus, &l3);
+        }
+        else
+        {
+            req_cpus = l3;
+        }
+        if (pin_res)
+        {
+            CPU_AND(&res_cpus, &res_cpus, &l3);
+        }
+        else
+        {
+            res_cpus = l3;
+        }
+        if (CPU_COUNT(&req_cpus) == 0 || CPU_COUNT(&res_cpus) == 0)
+        {
+            fprintf(stderr, "Requester and resolver CPUs must share an L3 cache with -L\n");
+            return EXIT_FAILURE;
+        }
+        pin_req = pin_res = true;
+    }
+
+    // threads may only be pinned to CPUs this process is allowed to use
+    cpu_set_t allowed;
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    if ((pin_req && (CPU_AND(&req_cpus, &req_cpus, &allowed), CPU_COUNT(&req_cpus) == 0)) ||
+        (pin_res && (CPU_AND(&res_cpus, &res_cpus, &allowed), CPU_COUNT(&res_cpus) == 0)))
+    {
+        fprintf(stderr, "No CPU of the requester or resolver list is available\n");
+        return EXIT_FAILURE;
+    }
+
+    // results of other processes cannot be put back in input order
+    if (export_name != NULL && order_window > 0)
+    {
+        fprintf(stderr, "Ordered output (-o) cannot be combined with -X\n");
+        return EXIT_FAILURE;
+    }
+
+    // every shard should have a resolver that calls it home, the others only steal from it
+    if (export_name == NULL && num_shards > min_res)
+    {
+        fprintf(stderr, "Shards must not outnumber the resolver threads\n");
+        return EXIT_FAILURE;
     }
 
     // create shared_array data structure for addresses
-    fifo shared_array;
-    init_q(&shared_array);
+    // init_q() writes every slot, so while on the requesters' CPUs it lands on their NUMA node
+    shard_queue shared_array;
+    cpu_set_t main_cpus;
+    bool moved = pin_req && move_to_cpus(&req_cpus, &main_cpus) == 0;
+    if (init_shards(&shared_array, num_shards, queue_size, queue_mode) != 0)
+    {
+        perror("Unable to allocate the hostname queue");
+        return EXIT_FAILURE;
+    }
+    if (moved)
+    {
+        restore_cpus(&main_cpus);
+    }
+
+    // with -X requesters copy hostnames into a shared memory fifo read by resolver processes
+    shm_fifo exported;
+    if (export_name != NULL && open_shm_fifo(&exported, export_name, queue_size, SHM_PRODUCER) != 0)
+    {
+        perror("Unable to open the shared memory fifo");
+        return EXIT_FAILURE;
+    }
+
+    // hostname strings travel from requesters to resolvers in blocks from this pool
+    name_pool names;
+    init_pool(&names);
+
+    // async resolvers speak DNS themselves, the other backends are only reachable synchronously
+    if (async_depth > 0 && strcmp(backend, "system") != 0)
+    {
+        fprintf(stderr, "Asynchronous resolvers (-a) require the system backend\n");
+        return EXIT_FAILURE;
+    }
+
+    resolver backend_resolver;
+    if (init_resolver(&backend_resolver, backend) != 0)
+    {
+        fprintf(stderr, "Unable to set up resolver backend %s\n", backend);
+        return EXIT_FAILURE;
+    }
+
+    // deadlines, retries and hedging run lookups on workers of their own, so a resolver can give up on one
+    attempt_pool attempts;
+    bool use_attempts = deadline_ms > 0 || retries > 0 || hedge;
+    if (use_attempts && async_depth > 0)
+    {
+        fprintf(stderr, "Asynchronous resolvers (-a) time out and retry queries themselves, -T, -R and -H do not apply\n");
+        return EXIT_FAILURE;
+    }
+    if (use_attempts && init_attempts(&attempts, &backend_resolver, 2 * num_res + 2, deadline_ms, retries, hedge) != 0)
+    {
+        perror("Unable to start the lookup workers");
+        return EXIT_FAILURE;
+    }
+
+    // with -D requesters drop or count hostnames they have seen before, before allocating a record
+    dedup_filter dedup;
+    if (use_dedup && init_dedup(&dedup, dedup_type, dedup_drop, input_bytes) != 0)
+    {
+        perror("Unable to allocate the duplicate filter");
+        return EXIT_FAILURE;
+    }
+
+    // results kept from earlier runs, only when enabled with -P
+    disk_cache store;
+    if (store_path != NULL && init_disk_cache(&store, store_path, store_slots, cache_ttl > 0 ? cache_ttl : DISK_CACHE_TTL) != 0)
+    {
+        perror("Unable to open the cache file");
+        return EXIT_FAILURE;
+    }
+
+    // results shared by all resolvers, only when enabled with -c
+    res_cache cache;
+    if (cache_ttl > 0 && init_cache(&cache, cache_ttl) != 0)
+    {
+        perror("Unable to allocate the result cache");
+        return EXIT_FAILURE;
+    }
+
+    // both logs are written by one thread, every requester and resolver has a stream into it
+    log_writer logs;
+    if (init_log_writer(&logs, num_req + num_res) != 0)
+    {
+        perror("Unable to start the log writer");
+        return EXIT_FAILURE;
+    }
+
+    // with -j every thread measures its share of the latencies
+    metrics stats;
+    if (report_path != NULL)
+    {
+        init_metrics(&stats);
+    }
+
+    // with -o resolver log lines are written in input order by the reorder buffer
+    reorder_buf reorder;
+    log_stream ordered_log;
+    init_log_stream(&ordered_log, &logs, fileno(res));
 
     // instantiate arg_structs for calls to pthread_create()
-    req_arg_struct req_args = {.data_files = &files, .shared_array = &shared_array, .req_log = req, .err_lock = &stderr_lock, .out_lock = &stdout_lock};
-    res_arg_struct res_args = {.shared_array = &shared_array, .res_log = res, .err_lock = &stderr_lock, .out_lock = &stdout_lock};
+    req_arg_struct req_args = {.data_files = &files, .shared_array = &shared_array, .names = &names, .use_mmap = use_mmap, .metrics = report_path != NULL ? &stats : NULL, .dedup = use_dedup ? &dedup : NULL, .exported = export_name != NULL ? &exported : NULL, .reorder = order_window > 0 ? &reorder : NULL, .source = stream_spec != NULL ? &source : NULL, .logs = &logs, .req_log = fileno(req), .err_lock = &stderr_lock, .out_lock = &stdout_lock};
+    res_arg_struct res_args = {.shared_array = &shared_array, .names = &names, .resolver = &backend_resolver, .cache = cache_ttl > 0 ? &cache : NULL, .attempts = use_attempts ? &attempts : NULL, .store = store_path != NULL ? &store : NULL, .async_depth = async_depth, .nameserver = nameserver, .streaming = stream_spec != NULL, .metrics = report_path != NULL ? &stats : NULL, .reorder = order_window > 0 ? &reorder : NULL, .ordered_log = &ordered_log, .logs = &logs, .res_log = fileno(res), .err_lock = &stderr_lock, .out_lock = &stdout_lock};
+
+    if (order_window > 0 && init_reorder(&reorder, order_window, order_policy, &write_ordered, &res_args) != 0)
+    {
+        perror("Unable to allocate the reorder buffer");
+        return EXIT_FAILURE;
+    }
 
     // create requester and resolver threads
-    pthread_t req_pool[num_req];
-    pthread_t res_pool[num_res];
+    pthread_t *req_pool = malloc(num_req * sizeof(pthread_t));
+    pthread_attr_t req_attr;
+    pthread_attr_init(&req_attr);
+    place_thread(&req_attr, pin_req ? &req_cpus : NULL);
+    resolver_pool res_pool = {.args = &res_args, .routine = async_depth > 0 ? &resolve_addr_async : &resolve_addr, .min = min_res, .max = num_res, .live = 0, .peak = 0, .stop = false, .cpus = pin_res ? &res_cpus : NULL};
+    pthread_mutex_init(&res_pool.lock, NULL);
+    pthread_cond_init(&res_pool.changed, NULL);
+
+    if (req_pool == NULL)
+    {
+        perror("Unable to allocate the requester threads");
+        return EXIT_FAILURE;
+    }
 
     for (int i = 0; i < num_req; i++)
     {
-        if (pthread_create(&req_pool[i], NULL, &service_file, (void *)&req_args))
+        if (pthread_create(&req_pool[i], &req_attr, stream_spec != NULL ? &service_stream : &service_file, (void *)&req_args))
         {
             pthread_mutex_lock(&stderr_lock);
             perror("Unable to create thread, terminating");
@@ -285,17 +1674,19 @@ int main(int argc, char *argv[])
             return EXIT_FAILURE;
         }
     }
+    pthread_attr_destroy(&req_attr);
 
-    for (int i = 0; i < num_res; i++)
+    // an autoscaled pool starts at its minimum and is resized by scale_resolvers()
+    pthread_mutex_lock(&res_pool.lock);
+    int started = add_resolvers(&res_pool, min_res);
+    pthread_mutex_unlock(&res_pool.lock);
+    if (started < min_res || (min_res < num_res && pthread_create(&res_pool.scaler, NULL, &scale_resolvers, &res_pool)))
     {
-        if (pthread_create(&res_pool[i], NULL, &resolve_addr, (void *)&res_args))
-        {
-            pthread_mutex_lock(&stderr_lock);
-            perror("Unable to create thread, terminating");
-            pthread_mutex_unlock(&stderr_lock);
+        pthread_mutex_lock(&stderr_lock);
+        perror("Unable to create thread, terminating");
+        pthread_mutex_unlock(&stderr_lock);
 
-            return EXIT_FAILURE;
-        }
+        return EXIT_FAILURE;
     }
 
     // wait for threads to complete
@@ -303,22 +1694,104 @@ int main(int argc, char *argv[])
     {
         pthread_join(req_pool[i], NULL);
     }
+    free(req_pool);
+    if (export_name != NULL)
+    {
+        close_shm_fifo(&exported); // resolver processes drain the rest and finish once every parser has closed it
+    }
 
-    for (int i = 0; i < num_res; i++)
+    if (min_res < num_res) // the scaler queues hostnames too, stop it before closing
     {
-        pthread_join(res_pool[i], NULL);
+        pthread_mutex_lock(&res_pool.lock);
+        res_pool.stop = true;
+        pthread_cond_broadcast(&res_pool.changed);
+        pthread_mutex_unlock(&res_pool.lock);
+        pthread_join(res_pool.scaler, NULL);
+        printf("resolver pool grew to %d of %d threads\n", res_pool.peak, num_res);
+    }
+    close_shards(&shared_array); // every hostname has been enqueued, resolvers drain the rest and exit
+
+    pthread_mutex_lock(&res_pool.lock);
+    while (res_pool.live > 0)
+    {
+        pthread_cond_wait(&res_pool.changed, &res_pool.lock);
+    }
+    pthread_mutex_unlock(&res_pool.lock);
+    if (order_window > 0)
+    {
+        if (reorder.skipped > 0)
+        {
+            printf("%lu results were written out of order\n", (unsigned long)reorder.skipped);
+        }
+        de_init_reorder(&reorder);
+    }
+    log_flush(&ordered_log);
+    de_init_log_writer(&logs); // every stream has been flushed, wait for the last writes
+    if (stream_spec != NULL)
+    {
+        close_source(&source);
     }
 
     // clean up
     fclose(req);
     fclose(res);
     de_init_q(&files);
-    de_init_q(&shared_array); // this frees the buffer variable inside the queue, so why isn't all memory freed?
+    for (int i = 0; i < argc - 5; i++)
+    {
+        free(file_chunks[i]);
+    }
+    free(file_chunks);
+    free(num_chunks);
+    if (num_shards > 1)
+    {
+        printf("resolvers stole %lu batches from other shards\n", (unsigned long)shared_array.steals);
+    }
+    de_init_shards(&shared_array); // this frees the buffer variable inside the queue, so why isn't all memory freed?
+    de_init_pool(&names);
+    if (export_name != NULL)
+    {
+        de_init_shm_fifo(&exported);
+    }
+    if (use_dedup)
+    {
+        printf("%s %lu duplicate hostnames\n", dedup_drop ? "suppressed" : "counted", (unsigned long)dedup.duplicates);
+        de_init_dedup(&dedup);
+    }
+    if (use_attempts)
+    {
+        if (attempts.hedged > 0)
+        {
+            printf("%lu lookups were hedged\n", (unsigned long)attempts.hedged);
+        }
+        de_init_attempts(&attempts); // waits for abandoned attempts before the backend goes
+    }
+    de_init_resolver(&backend_resolver);
+    if (cache_ttl > 0)
+    {
+        de_init_cache(&cache);
+    }
+    if (store_path != NULL && de_init_disk_cache(&store) != 0)
+    {
+        perror("Unable to write the cache file");
+    }
+
+    if (report_path != NULL)
+    {
+        FILE *report = fopen(report_path, "w");
+        if (report == NULL || write_metrics(&stats, report) != 0)
+        {
+            perror("Unable to write the metrics report");
+        }
+        if (report != NULL)
+        {
+            fclose(report);
+        }
+        de_init_metrics(&stats);
+    }
 
     // complete runtime measurement and output result
-    gettimeofday(&tv_end, 0);
-    long elapsed = (tv_end.tv_sec - tv_start.tv_sec);
-    printf("%s: total time is %ld seconds\n", argv[0], elapsed);
+    double elapsed = (metrics_now() - start_ns) / 1e9;
+    printf("%s: total time is %.3f seconds\n", argv[0], elapsed);
 
     return EXIT_SUCCESS;
 }
@@ -9,25 +9,174 @@ A header file used to implement multi-lookup
 #ifndef MULTI_LOOKUP_H
 #define MULTI_LOOKUP_H
 
-#define MAX_INPUT_FILES 100
-#define MAX_REQUESTER_THREADS 10
-#define MAX_RESOLVER_THREADS 10
+#include "shared_array.h"
+#include "name_pool.h"
+#include "res_cache.h"
+#include "async_dns.h"
+#include "resolver.h"
+#include "input.h"
+#include "log_writer.h"
+#include "source.h"
+#include "reorder.h"
+#include "metrics.h"
+#include "attempt.h"
+#include "disk_cache.h"
+#include "placement.h"
+#include "shard_queue.h"
+#include "dedup.h"
+#include "shm_fifo.h"
+#include <stdio.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
 #define MAX_NAME_LENGTH 255
 #define MAX_IP_LENGTH INET6_ADDRSTRLEN
+#define CHUNK_SIZE (1 << 20) // default bytes of a data file a requester claims at a time
+#define STREAM_BUF_SIZE (64 * 1024) // bytes a streaming requester reads at a time
+#define REQ_BATCH_SIZE 64 // hostnames a requester hands to the shared array per en_q_n()
+#define RES_BATCH_SIZE 8  // hostnames a resolver takes from the shared array per de_q_n()
+#define ASYNC_BATCH_SIZE 64 // hostnames an async resolver starts or finishes per step
+#define ASYNC_POLL_MS 10    // how often an async resolver with room checks the shared array
+#define SCALE_INTERVAL_MS 100 // how often an autoscaled resolver pool is resized
+#define SCALE_TARGET_MS 200   // queued work the resolvers should clear within this time
+#define SCALE_IDLE_TICKS 10   // intervals the queue must stay empty before a resolver retires
+#define SCALE_FULL_TICKS 3    // intervals the queue must stay nearly full before the pool grows anyway
+
+/*
+Declare a struct of type host_rec, a hostname on its way from a
+requester to a resolver, allocated from the name pool.
+
+With -m the name is a slice of the mapped data file src, otherwise
+a copy kept in text and src is NULL. Either way it is not NUL
+terminated, see len.
+*/
+typedef struct
+{
+    const char *name;
+    int len;
+    input_file *src;
+    uint64_t seq;     // position in the input, for ordered output
+    uint64_t parsed_ns;   // metrics_now() when read, set only with -j
+    uint64_t enqueued_ns;
+    uint64_t started_ns;  // lookup started, async resolvers only
+    const char *reason;   // why the lookup failed, written after NOT_RESOLVED if set
+    char text[];
+} host_rec;
+
+/*
+Hostnames a requester has parsed but not yet handed to the shared
+array. All come from the same data file, src when it is mapped.
+
+With ordered output a requester holds back all hostnames of a chunk
+until every earlier chunk has been numbered.
+*/
+typedef struct
+{
+    void *items[REQ_BATCH_SIZE];
+    int count;
+    input_file *src;
+    log_stream log; // the requester's lines of the requester log
+    bool holding;   // keep hostnames in held until the chunk's turn to be numbered
+    void **held;
+    int num_held;
+    int held_cap;
+} req_batch;
+
+/*
+Used to pass multiple args to a start routine in pthread_create()
+*/
+typedef struct
+{
+    fifo *data_files;
+    shard_queue *shared_array;
+    name_pool *names;
+    bool use_mmap;    // map data files instead of reading them with getline()
+    input_source *source; // for service_stream(), instead of data_files
+    reorder_buf *reorder; // numbers hostnames for ordered output, NULL if disabled
+    metrics *metrics;     // NULL unless latency metrics are collected
+    dedup_filter *dedup;  // recognizes repeated hostnames, NULL if disabled
+    shm_fifo *exported;   // hostnames go to resolver processes through this, NULL to resolve them here
+    log_writer *logs;
+    int req_log;      // descriptor of the requester log
+    pthread_mutex_t *err_lock;
+    pthread_mutex_t *out_lock;
+} req_arg_struct;
+
+typedef struct
+{
+    shard_queue *shared_array;
+    name_pool *names;
+    resolver *resolver;
+    res_cache *cache; // NULL when caching is disabled
+    attempt_pool *attempts; // deadlines, retries and hedging, NULL when disabled
+    disk_cache *store; // results kept across runs, NULL when disabled
+    int async_depth;  // queries in flight per resolve_addr_async() thread
+    char *nameserver; // for resolve_addr_async(), NULL for /etc/resolv.conf
+    bool streaming;   // write results out as they complete rather than in full buffers
+    reorder_buf *reorder;    // puts results back in input order, NULL if disabled
+    metrics *metrics;        // NULL unless latency metrics are collected
+    log_stream *ordered_log; // written by the reorder buffer under its lock
+    int retiring;     // resolvers sent a NULL hostname to exit on but not yet gone
+    uint64_t lookup_ns; // time resolve_addr() threads spent in lookups, for scaling the pool
+    uint64_t lookups;
+    log_writer *logs;
+    int res_log;      // descriptor of the resolver log
+    pthread_mutex_t *err_lock;
+    pthread_mutex_t *out_lock;
+} res_arg_struct;
+
+/*
+Declare a struct of type resolver_pool, the resolver threads.
+
+A pool runs min threads to begin with. If max is larger the pool is
+autoscaled, a separate thread adds and retires resolvers between the
+two bounds following the depth of the shared array and the latency
+of lookups (see scale_resolvers() in multi-lookup.c).
+*/
+typedef struct
+{
+    res_arg_struct *args;
+    void *(*routine)(void *); // resolve_addr() or resolve_addr_async()
+    int min;
+    int max;
+    int live;                 // resolver threads running
+    int peak;                 // most resolver threads running at once
+    bool stop;                // tells the scaler thread to exit
+    pthread_mutex_t lock;
+    pthread_cond_t changed;   // broadcast when a resolver exits or stop is set
+    pthread_t scaler;
+    cpu_set_t *cpus;          // CPUs resolvers run on, NULL for any
+} resolver_pool;
 
 /*
 PRODUCER FUNCTION
 
 Expects as argument a struct containing a pointer to a queue (fifo struct, see shared_array.h)
-that already contains all the files to parse for hostnames, a pointer to a separate queue
-used to store all hostnames themselves, and a file pointer to a resolution log file
+that already contains every chunk of the data files to parse for hostnames (see input.h),
+a pointer to a separate queue used to store all hostnames themselves, and a file pointer
+to a resolution log file
 
-This function will iteratively parse all supplied files line by line and enqueue
-the hostname present on a line into a shared array. Continues until all files
-have been parsed, and then exits.
+This function will iteratively claim chunks and parse them line by line, enqueueing
+the hostname present on a line into a shared array. Large files are cut into many chunks,
+so all requesters share the work of a single file and one that finishes early simply
+claims the next chunk. Continues until all chunks have been parsed, and then exits.
 */
 void *service_file(void *arguments);
 
+/*
+STREAMING PRODUCER FUNCTION
+
+Expects the same argument as service_file(), with source set instead of
+a queue of data files.
+
+Reads hostnames, one per line, from the streams of the source (see
+source.h) and hands them to the shared array as soon as each read
+completes rather than once a batch is full, so names trickling in are
+resolved without delay. Continues until the source runs out of streams
+or is stopped, and then exits.
+*/
+void *service_stream(void *arguments);
+
 
 /*
 CONSUMER FUNCTION
@@ -35,14 +184,30 @@ CONSUMER FUNCTION
 Expects as argument a struct containing a pointer to the shared array (queue) used to store address names
 and a pointer to a requester log file.
 
-Dequeues address names from the shared array and passes these hostnames to the dnslookup()
-function declared in util.h and defined in util.c
+Dequeues address names from the shared array and passes these hostnames to the resolver
+backend selected on the command line (see resolver.h), unless the result cache already
+holds a result for the name
 
 If the DNS lookup was successful, writes the original host address name and ip address to the resolver log file.
 If the lookup failed, writes the original host address name and "NOT RESOLVED" to the resolver log file.
 
-Continues until the queue is empty, and then exits.
+Continues until the requesters have closed the queue and it has been
+drained, and then exits.
 */
 void *resolve_addr(void *arguments);
 
+/*
+ASYNCHRONOUS CONSUMER FUNCTION
+
+Expects the same argument as resolve_addr(), with async_depth set.
+
+Keeps up to async_depth DNS queries in flight through a non-blocking client (see
+async_dns.h) instead of blocking in the resolver backend for one name at a time, and writes
+each result to the resolver log as its answer arrives.
+
+Continues until the requesters have closed the queue, it has been drained
+and every answer has arrived, and then exits.
+*/
+void *resolve_addr_async(void *arguments);
+
 #endif
\ No newline at end of file
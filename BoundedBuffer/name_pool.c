@@ -0,0 +1,251 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+Implementation of a slab allocator for the hostname
+strings passed between threads.
+*/
+
+#include "name_pool.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+Declare a struct of type pool_list, a thread private free list
+of blocks of one size class.
+*/
+typedef struct
+{
+    pool_block *free;
+    size_t count;
+} pool_list;
+
+static __thread pool_list cache[POOL_NUM_CLASSES];
+
+/*
+Returns the index of the smallest size class able to hold
+size bytes after the block header, or -1 if none can.
+*/
+static int size_class(size_t size)
+{
+    size_t block = POOL_MIN_BLOCK;
+    int c = 0;
+
+    while (block - POOL_HEADER_SIZE < size)
+    {
+        block <<= 1;
+        c++;
+    }
+
+    return c < POOL_NUM_CLASSES ? c : -1;
+}
+
+/*
+Cuts one block of size class c from the newest chunk, allocating
+a new chunk when the current one is used up.
+The caller must hold the pool lock.
+
+Returns NULL if a new chunk could not be allocated.
+*/
+static pool_block *carve(name_pool *p, int c)
+{
+    size_t block = (size_t)POOL_MIN_BLOCK << c;
+
+    if (p->cursor == NULL || p->cursor + block > p->limit)
+    {
+        void **chunk = malloc(POOL_CHUNK_SIZE);
+        if (chunk == NULL)
+        {
+            return NULL;
+        }
+
+        *chunk = p->chunks; // the first block slot links the chunks together
+        p->chunks = chunk;
+        p->cursor = (char *)chunk + POOL_MIN_BLOCK;
+        p->limit = (char *)chunk + POOL_CHUNK_SIZE;
+    }
+
+    pool_block *b = (pool_block *)p->cursor;
+    p->cursor += block;
+
+    return b;
+}
+
+/*
+Fills an empty thread cache with a batch of blocks of size class c,
+taken from the depot when one is available or carved from a chunk.
+*/
+static void refill(name_pool *p, int c, pool_list *list)
+{
+    pthread_mutex_lock(&p->lock);
+
+    if (p->depot[c] != NULL)
+    {
+        pool_block *batch = p->depot[c];
+        p->depot[c] = batch->next_batch;
+
+        list->free = batch;
+        list->count = batch->batch_count;
+    }
+    else
+    {
+        for (int i = 0; i < POOL_BATCH; i++)
+        {
+            pool_block *b = carve(p, c);
+            if (b == NULL)
+            {
+                break;
+            }
+
+            b->next = list->free;
+            list->free = b;
+            list->count++;
+        }
+    }
+
+    pthread_mutex_unlock(&p->lock);
+}
+
+/*
+Moves the first n blocks of a thread cache to the depot as one batch.
+*/
+static void ship(name_pool *p, int c, pool_list *list, size_t n)
+{
+    pool_block *batch = list->free;
+    pool_block *last = batch;
+
+    for (size_t i = 1; i < n; i++)
+    {
+        last = last->next;
+    }
+
+    list->free = last->next;
+    list->count -= n;
+    last->next = NULL;
+    batch->batch_count = n;
+
+    pthread_mutex_lock(&p->lock);
+    batch->next_batch = p->depot[c];
+    p->depot[c] = batch;
+    pthread_mutex_unlock(&p->lock);
+}
+
+/*
+Intended to be called once by the calling program.
+
+Expects as sole argument an address of a name_pool struct.
+
+Initializes an empty pool, chunks are only allocated once the
+first block is requested.
+
+Returns 0 on success.
+*/
+int init_pool(name_pool *p)
+{
+    memset(p, 0, sizeof(*p));
+    pthread_mutex_init(&p->lock, NULL);
+
+    return 0;
+}
+
+/*
+Hands out a block able to hold size bytes, e.g. strlen(name) + 1.
+
+Expects two arguments:
+1. Address of name_pool struct
+2. The number of bytes needed
+
+Served from the calling thread's free list for the matching size
+class, which is refilled a batch at a time when it runs dry.
+
+Returns NULL if size exceeds the largest size class or memory
+is exhausted.
+*/
+void *pool_alloc(name_pool *p, size_t size)
+{
+    int c = size_class(size);
+    if (c < 0)
+    {
+        return NULL;
+    }
+
+    pool_list *list = &cache[c];
+    if (list->free == NULL)
+    {
+        refill(p, c, list);
+        if (list->free == NULL)
+        {
+            return NULL;
+        }
+    }
+
+    pool_block *b = list->free;
+    list->free = b->next;
+    list->count--;
+    b->size_class = c;
+
+    return (char *)b + POOL_HEADER_SIZE;
+}
+
+/*
+Returns a block obtained from pool_alloc() to the pool. May be
+called from any thread, not just the one that allocated it.
+
+The block goes onto the calling thread's free list. Once that list
+holds two batches worth of blocks one batch is moved to the depot,
+where threads that allocate can pick it up.
+*/
+void pool_free(name_pool *p, void *ptr)
+{
+    pool_block *b = (pool_block *)((char *)ptr - POOL_HEADER_SIZE);
+    int c = b->size_class;
+    pool_list *list = &cache[c];
+
+    b->next = list->free;
+    list->free = b;
+    list->count++;
+
+    if (list->count >= 2 * POOL_BATCH)
+    {
+        ship(p, c, list, POOL_BATCH);
+    }
+}
+
+/*
+Moves every block cached by the calling thread to the depot.
+Intended to be called by a thread before it exits, so the blocks
+it freed can be reused by the threads that remain.
+*/
+void pool_thread_flush(name_pool *p)
+{
+    for (int c = 0; c < POOL_NUM_CLASSES; c++)
+    {
+        if (cache[c].count > 0)
+        {
+            ship(p, c, &cache[c], cache[c].count);
+        }
+    }
+}
+
+/*
+Used to free every chunk allocated by the pool. Intended to be
+called once every thread using the pool has exited, any block
+still handed out becomes invalid.
+
+Returns 0 on success.
+*/
+int de_init_pool(name_pool *p)
+{
+    while (p->chunks != NULL)
+    {
+        void *next = *(void **)p->chunks;
+        free(p->chunks);
+        p->chunks = next;
+    }
+
+    memset(cache, 0, sizeof(cache)); // the caller's cache pointed into the chunks
+    pthread_mutex_destroy(&p->lock);
+
+    return 0;
+}
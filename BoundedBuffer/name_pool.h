@@ -0,0 +1,72 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+A header file used to implement a slab allocator
+for the hostname strings passed between threads.
+*/
+
+#ifndef NAME_POOL_H
+#define NAME_POOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#define POOL_CHUNK_SIZE (64 * 1024) // bytes requested from malloc() at a time
+#define POOL_MIN_BLOCK 32           // smallest size class, classes double up to POOL_MAX_BLOCK
+#define POOL_MAX_BLOCK 512
+#define POOL_NUM_CLASSES 5
+#define POOL_BATCH 64               // blocks moved between a thread cache and the depot at once
+
+/*
+Declare a struct of type pool_block that overlays every block
+handed out by the pool.
+
+While a block is in use only the header word is reserved, it
+records the size class, and the string starts right after it.
+While a block is free the header links it into a free list, and
+the first block of a batch in the depot also records the next
+batch and how many blocks its list holds.
+*/
+typedef struct pool_block
+{
+    union
+    {
+        struct pool_block *next; // while free: next block in the list
+        size_t size_class;       // while in use: index into the size classes
+    };
+    struct pool_block *next_batch;
+    size_t batch_count;
+} pool_block;
+
+#define POOL_HEADER_SIZE (sizeof(size_t))
+
+/*
+Declare a struct of type name_pool that hands out blocks from
+large chunks, carved into power of two size classes.
+
+Each thread keeps a private free list per size class (see
+name_pool.c) so allocation and release are normally lock free.
+Blocks travel between threads through the depot: a thread that
+frees more than it allocates, such as a resolver, returns full
+batches to the depot and a thread that runs dry, such as a
+requester, takes a whole batch back under a single lock.
+
+The per thread free lists belong to a single pool at a time.
+*/
+typedef struct
+{
+    pthread_mutex_t lock;                 // guards depot, chunks and the bump region
+    pool_block *depot[POOL_NUM_CLASSES];  // batches of free blocks, linked through next_batch
+    void *chunks;                         // chunks allocated so far, linked through their first word
+    char *cursor, *limit;                 // unused part of the newest chunk
+} name_pool;
+
+int init_pool(name_pool *p);
+void *pool_alloc(name_pool *p, size_t size);
+void pool_free(name_pool *p, void *ptr);
+void pool_thread_flush(name_pool *p);
+int de_init_pool(name_pool *p);
+
+#endif
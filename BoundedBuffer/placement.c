@@ -0,0 +1,198 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+Implementation of thread placement on CPU sets and
+first-touch placement of memory.
+*/
+
+#define _GNU_SOURCE // cpu_set_t, pthread_attr_setaffinity_np()
+#include "placement.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/*
+Expects two arguments:
+1. a list of CPUs in the kernel's format, such as "0-3,8,10-11"
+2. the set the CPUs are put in
+
+Returns 0 on success, -1 if the list is malformed, names a CPU
+beyond CPU_SETSIZE or is empty
+*/
+int parse_cpus(const char *list, cpu_set_t *set)
+{
+    const char *p = list;
+
+    CPU_ZERO(set);
+
+    while (*p != '\0' && *p != '\n')
+    {
+        char *end;
+        long lo = strtol(p, &end, 10);
+        long hi = lo;
+
+        if (end == p)
+        {
+            return -1;
+        }
+        p = end;
+
+        if (*p == '-')
+        {
+            hi = strtol(p + 1, &end, 10);
+            if (end == p + 1)
+            {
+                return -1;
+            }
+            p = end;
+        }
+
+        if (lo < 0 || hi < lo || hi >= CPU_SETSIZE)
+        {
+            return -1;
+        }
+        for (long cpu = lo; cpu <= hi; cpu++)
+        {
+            CPU_SET(cpu, set);
+        }
+
+        if (*p == ',')
+        {
+            p++;
+        }
+        else if (*p != '\0' && *p != '\n')
+        {
+            return -1;
+        }
+    }
+
+    return CPU_COUNT(set) > 0 ? 0 : -1;
+}
+
+/*
+Finds the CPUs sharing the last level 3 cache with cpu, from the
+cache topology the kernel exports in sysfs.
+
+Returns 0 on success, -1 if the topology could not be read or the
+CPU has no level 3 cache
+*/
+int l3_cpus(int cpu, cpu_set_t *set)
+{
+    char dir[128];
+    char path[192];
+    char line[1024];
+
+    snprintf(dir, sizeof(dir), CPU_CACHE_PATH, cpu);
+
+    for (int index = 0;; index++)
+    {
+        int level = 0;
+
+        snprintf(path, sizeof(path), "%s/index%d/level", dir, index);
+        FILE *f = fopen(path, "r");
+        if (f == NULL)
+        {
+            return -1; // no more caches
+        }
+        if (fscanf(f, "%d", &level) != 1)
+        {
+            level = 0;
+        }
+        fclose(f);
+
+        if (level != 3)
+        {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "%s/index%d/shared_cpu_list", dir, index);
+        f = fopen(path, "r");
+        if (f == NULL)
+        {
+            return -1;
+        }
+        char *read = fgets(line, sizeof(line), f);
+        fclose(f);
+
+        return read != NULL ? parse_cpus(line, set) : -1;
+    }
+}
+
+/*
+Returns the lowest CPU in a set, -1 if it is empty.
+*/
+int first_cpu(const cpu_set_t *set)
+{
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (CPU_ISSET(cpu, set))
+        {
+            return cpu;
+        }
+    }
+
+    return -1;
+}
+
+/*
+Makes threads created with attr run only on the CPUs in set.
+A NULL set leaves them to the scheduler.
+
+Returns 0 on success, an error number on failure
+*/
+int place_thread(pthread_attr_t *attr, const cpu_set_t *set)
+{
+    if (set == NULL)
+    {
+        return 0;
+    }
+
+    return pthread_attr_setaffinity_np(attr, sizeof(cpu_set_t), set);
+}
+
+/*
+Moves the calling thread onto the CPUs in set, saving the CPUs it
+could run on before. Memory the thread touches first from now on is
+placed by the kernel on the NUMA node of those CPUs, so this is how
+memory is allocated on the node of the threads that will use it.
+
+Returns 0 on success, -1 with errno set on failure
+*/
+int move_to_cpus(const cpu_set_t *set, cpu_set_t *saved)
+{
+    int err = pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), saved);
+
+    if (err == 0)
+    {
+        err = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), set);
+    }
+    if (err != 0)
+    {
+        errno = err;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+Lets the calling thread run on the CPUs saved by move_to_cpus()
+again.
+
+Returns 0 on success, -1 with errno set on failure
+*/
+int restore_cpus(const cpu_set_t *saved)
+{
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), saved);
+
+    if (err != 0)
+    {
+        errno = err;
+        return -1;
+    }
+
+    return 0;
+}
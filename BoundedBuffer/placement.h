@@ -0,0 +1,29 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+A header file used to place threads on CPU sets and
+memory on the NUMA node of the threads using it.
+
+Files including it must define _GNU_SOURCE before any
+system header.
+*/
+
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+
+#define CPU_CACHE_PATH "/sys/devices/system/cpu/cpu%d/cache"
+
+int parse_cpus(const char *list, cpu_set_t *set);
+int l3_cpus(int cpu, cpu_set_t *set);
+int first_cpu(const cpu_set_t *set);
+int place_thread(pthread_attr_t *attr, const cpu_set_t *set);
+int move_to_cpus(const cpu_set_t *set, cpu_set_t *saved);
+int restore_cpus(const cpu_set_t *saved);
+
+#endif
@@ -0,0 +1,182 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+Implementation of the bounded reorder buffer.
+*/
+
+#include "reorder.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+Expects five arguments:
+1. a pointer to a reorder_buf struct
+2. the most results held back at a time
+3. what to do when the window is full, see reorder_policy
+4. the function that writes a result out
+5. passed to emit as its first argument
+
+Returns 0 on success, -1 if memory could not be allocated
+*/
+int init_reorder(reorder_buf *r, size_t window, reorder_policy policy, void (*emit)(void *, void *, const char *), void *context)
+{
+    r->slots = calloc(window, sizeof(reorder_slot));
+    if (r->slots == NULL)
+    {
+        return -1;
+    }
+
+    r->window = window;
+    r->policy = policy;
+    r->next = 0;
+    r->claimed = 0;
+    r->turn = 0;
+    r->skipped = 0;
+    r->emit = emit;
+    r->context = context;
+    sem_init(&r->room, 0, window);
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->turn_done, NULL);
+
+    return 0;
+}
+
+/*
+Waits until every producer with a lower ticket has called
+reorder_end(). Tickets start at 0 and every one must be used.
+*/
+void reorder_begin(reorder_buf *r, uint64_t ticket)
+{
+    pthread_mutex_lock(&r->lock);
+    while (r->turn != ticket)
+    {
+        pthread_cond_wait(&r->turn_done, &r->lock);
+    }
+    pthread_mutex_unlock(&r->lock);
+}
+
+/*
+Hands the turn to the producer with the next ticket.
+*/
+void reorder_end(reorder_buf *r)
+{
+    pthread_mutex_lock(&r->lock);
+    r->turn++;
+    pthread_cond_broadcast(&r->turn_done);
+    pthread_mutex_unlock(&r->lock);
+}
+
+/*
+Numbers n items, which must be no more than the window.
+
+With REORDER_WAIT this waits until the window has room for all of
+them, so results never have to be held back beyond it.
+
+Returns the number of the first item, the others follow it.
+*/
+uint64_t reorder_claim(reorder_buf *r, int n)
+{
+    if (r->policy == REORDER_WAIT)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            sem_wait(&r->room);
+        }
+    }
+
+    return __atomic_fetch_add(&r->claimed, n, __ATOMIC_RELAXED);
+}
+
+/*
+Writes out every result at the front of the window that is ready.
+Must be called with the lock held.
+*/
+static void drain(reorder_buf *r)
+{
+    for (;;)
+    {
+        reorder_slot *s = &r->slots[r->next % r->window];
+        if (!s->ready)
+        {
+            return;
+        }
+
+        r->emit(r->context, s->item, s->resolved ? s->ip : NULL);
+        s->ready = false;
+        r->next++;
+        if (r->policy == REORDER_WAIT)
+        {
+            sem_post(&r->room);
+        }
+    }
+}
+
+/*
+Expects four arguments:
+1. a pointer to a reorder_buf struct
+2. the number reorder_claim() gave the item
+3. the item, handed to emit
+4. the address it resolved to, NULL if it failed
+
+Writes out the result and any held back results it was blocking,
+or holds it back until the results before it arrive.
+*/
+void reorder_put(reorder_buf *r, uint64_t seq, void *item, const char *ip)
+{
+    pthread_mutex_lock(&r->lock);
+
+    if (seq < r->next) // the window moved on without it
+    {
+        r->emit(r->context, item, ip);
+        pthread_mutex_unlock(&r->lock);
+        return;
+    }
+
+    // REORDER_SKIP: make room by writing out what is held and passing over the gaps
+    while (seq >= r->next + r->window)
+    {
+        reorder_slot *s = &r->slots[r->next % r->window];
+        if (s->ready)
+        {
+            r->emit(r->context, s->item, s->resolved ? s->ip : NULL);
+            s->ready = false;
+        }
+        else
+        {
+            r->skipped++;
+        }
+        r->next++;
+    }
+
+    reorder_slot *s = &r->slots[seq % r->window];
+    s->item = item;
+    s->resolved = ip != NULL;
+    if (ip != NULL)
+    {
+        strncpy(s->ip, ip, REORDER_IP_LENGTH - 1);
+        s->ip[REORDER_IP_LENGTH - 1] = '\0';
+    }
+    s->ready = true;
+
+    drain(r);
+    pthread_mutex_unlock(&r->lock);
+}
+
+/*
+Expects as sole argument a pointer to a reorder_buf struct
+
+Must only be called once every claimed item has been put.
+
+Returns 0 on success
+*/
+int de_init_reorder(reorder_buf *r)
+{
+    free(r->slots);
+    sem_destroy(&r->room);
+    pthread_mutex_destroy(&r->lock);
+    pthread_cond_destroy(&r->turn_done);
+
+    return 0;
+}
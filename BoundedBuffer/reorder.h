@@ -0,0 +1,78 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+A header file used to implement a bounded reorder
+buffer that puts results back in input order.
+*/
+
+#ifndef REORDER_H
+#define REORDER_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <arpa/inet.h>
+
+#define REORDER_IP_LENGTH INET6_ADDRSTRLEN
+
+/*
+What happens when the oldest result is missing and the window is full
+*/
+typedef enum
+{
+    REORDER_WAIT, // producers wait before numbering more items, output stays in order
+    REORDER_SKIP  // the window moves on, the missing result is written whenever it arrives
+} reorder_policy;
+
+/*
+Declare a struct of type reorder_slot that holds one finished item
+until every item before it has been written.
+*/
+typedef struct
+{
+    bool ready;
+    bool resolved;
+    void *item;
+    char ip[REORDER_IP_LENGTH];
+} reorder_slot;
+
+/*
+Declare a struct of type reorder_buf.
+
+Producers number items with reorder_claim(). Results are put back
+with reorder_put() in any order and passed to emit in numbering
+order, at most window of them waiting at a time. Slot i % window
+holds item i.
+
+Producers that must number items in a fixed order among themselves,
+such as requesters parsing consecutive chunks of a file, each take a
+ticket and call reorder_begin() and reorder_end() around their claims.
+*/
+typedef struct
+{
+    reorder_slot *slots;
+    size_t window;
+    reorder_policy policy;
+    uint64_t next;      // number of the next item to emit
+    uint64_t claimed;   // numbers handed out so far
+    uint64_t turn;      // ticket of the producer allowed to claim
+    uint64_t skipped;   // items emitted out of order (REORDER_SKIP)
+    sem_t room;         // free positions in the window (REORDER_WAIT)
+    pthread_mutex_t lock;
+    pthread_cond_t turn_done;
+    void (*emit)(void *context, void *item, const char *ip); // called with lock held
+    void *context;
+} reorder_buf;
+
+int init_reorder(reorder_buf *r, size_t window, reorder_policy policy, void (*emit)(void *, void *, const char *), void *context);
+void reorder_begin(reorder_buf *r, uint64_t ticket);
+uint64_t reorder_claim(reorder_buf *r, int n);
+void reorder_end(reorder_buf *r);
+void reorder_put(reorder_buf *r, uint64_t seq, void *item, const char *ip);
+int de_init_reorder(reorder_buf *r);
+
+#endif
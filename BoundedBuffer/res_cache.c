@@ -0,0 +1,412 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+Implementation of a concurrent cache
+of hostname resolution results.
+*/
+
+#include "res_cache.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <stdbool.h>
+
+/*
+Returns the current CLOCK_MONOTONIC time in nanoseconds.
+*/
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+64 bit FNV-1a hash of a hostname. The low bits select the
+shard and the remaining bits the bucket within it.
+*/
+uint64_t hash_name(const char *name)
+{
+    return hash_name_n(name, strlen(name));
+}
+
+/*
+Same as hash_name(), for a hostname of len bytes that need not be
+NUL terminated.
+*/
+uint64_t hash_name_n(const char *name, size_t len)
+{
+    uint64_t h = 14695981039346656037ULL;
+
+    for (const unsigned char *p = (const unsigned char *)name; p < (const unsigned char *)name + len; p++)
+    {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+
+    return h;
+}
+
+static cache_shard *shard_of(res_cache *c, uint64_t hash)
+{
+    return &c->shards[hash & (CACHE_SHARDS - 1)];
+}
+
+static size_t bucket_of(cache_shard *s, uint64_t hash)
+{
+    return (hash / CACHE_SHARDS) & (s->num_buckets - 1);
+}
+
+/*
+Returns the entry for name in shard s, or NULL.
+The caller must hold the shard lock.
+*/
+static cache_entry *find(cache_shard *s, const char *name, uint64_t hash)
+{
+    for (cache_entry *e = s->buckets[bucket_of(s, hash)]; e != NULL; e = e->next)
+    {
+        if (e->hash == hash && strcmp(e->name, name) == 0)
+        {
+            return e;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+Frees the expired entries of bucket b of shard s. Pending entries
+stay, threads wait for them. The caller must hold the shard lock.
+*/
+static void sweep_bucket(cache_shard *s, size_t b, uint64_t now)
+{
+    cache_entry **link = &s->buckets[b];
+
+    while (*link != NULL)
+    {
+        cache_entry *e = *link;
+        if (e->state != ENTRY_PENDING && e->expires <= now)
+        {
+            *link = e->next;
+            free(e);
+            s->count--;
+        }
+        else
+        {
+            link = &e->next;
+        }
+    }
+}
+
+/*
+Frees one result of shard s to make room for a new name, the last
+one of the next bucket from hand on that holds any. New entries are
+added at the head of a chain, so that one has been kept the longest.
+The caller must hold the shard lock.
+*/
+static void evict(cache_shard *s)
+{
+    for (size_t i = 0; i < s->num_buckets; i++)
+    {
+        size_t b = s->hand++ & (s->num_buckets - 1);
+        cache_entry **victim = NULL;
+
+        for (cache_entry **link = &s->buckets[b]; *link != NULL; link = &(*link)->next)
+        {
+            if ((*link)->state != ENTRY_PENDING)
+            {
+                victim = link;
+            }
+        }
+
+        if (victim != NULL)
+        {
+            cache_entry *e = *victim;
+            *victim = e->next;
+            free(e);
+            s->count--;
+            return;
+        }
+    }
+}
+
+/*
+Doubles the number of buckets of shard s once it holds more than
+two entries per bucket. The caller must hold the shard lock.
+*/
+static void grow(cache_shard *s)
+{
+    size_t old_count = s->num_buckets;
+    cache_entry **old = s->buckets;
+    cache_entry **buckets = calloc(old_count * 2, sizeof(cache_entry *));
+
+    if (buckets == NULL)
+    {
+        return; // keep the longer chains
+    }
+
+    s->buckets = buckets;
+    s->num_buckets = old_count * 2;
+
+    for (size_t i = 0; i < old_count; i++)
+    {
+        cache_entry *e = old[i];
+        while (e != NULL)
+        {
+            cache_entry *next = e->next;
+            size_t b = bucket_of(s, e->hash);
+            e->next = s->buckets[b];
+            s->buckets[b] = e;
+            e = next;
+        }
+    }
+
+    free(old);
+}
+
+/*
+Intended to be called once by the calling program.
+
+Expects two arguments:
+1. Address of res_cache struct
+2. How long, in seconds, a result stays valid
+
+Returns 0 on success, -1 if the buckets could not be allocated.
+*/
+int init_cache(res_cache *c, int ttl_seconds)
+{
+    c->ttl = (uint64_t)ttl_seconds * 1000000000ULL;
+
+    for (int i = 0; i < CACHE_SHARDS; i++)
+    {
+        cache_shard *s = &c->shards[i];
+        s->buckets = calloc(CACHE_INITIAL_BUCKETS, sizeof(cache_entry *));
+        if (s->buckets == NULL)
+        {
+            return -1;
+        }
+        s->num_buckets = CACHE_INITIAL_BUCKETS;
+        s->count = 0;
+        s->hand = 0;
+        pthread_mutex_init(&s->lock, NULL);
+        pthread_cond_init(&s->done, NULL);
+    }
+
+    return 0;
+}
+
+/*
+Shared by cache_lookup() and cache_try_lookup(). If wait is false and
+another thread is resolving the name, returns CACHE_PENDING instead
+of waiting for it.
+*/
+static int lookup_entry(res_cache *c, const char *name, char *ip, int size, bool wait)
+{
+    uint64_t hash = hash_name(name);
+    cache_shard *s = shard_of(c, hash);
+
+    pthread_mutex_lock(&s->lock);
+
+    cache_entry *e = find(s, name, hash);
+    while (e != NULL && e->state == ENTRY_PENDING)
+    {
+        if (!wait)
+        {
+            pthread_mutex_unlock(&s->lock);
+            return CACHE_PENDING;
+        }
+
+        pthread_cond_wait(&s->done, &s->lock);
+        e = find(s, name, hash); // the result may have been evicted already, then look it up again
+    }
+
+    if (e == NULL)
+    {
+        size_t len = strlen(name);
+        e = malloc(sizeof(cache_entry) + len + 1);
+        if (e == NULL)
+        {
+            pthread_mutex_unlock(&s->lock);
+            return CACHE_MISS; // caching is best effort, cache_fill() ignores unknown names
+        }
+
+        memcpy(e->name, name, len + 1);
+        e->hash = hash;
+        e->state = ENTRY_PENDING;
+
+        uint64_t now = now_ns();
+        size_t b = bucket_of(s, hash);
+        sweep_bucket(s, b, now);
+        if (s->count >= CACHE_MAX_ENTRIES)
+        {
+            evict(s);
+        }
+        e->next = s->buckets[b];
+        s->buckets[b] = e;
+
+        if (++s->count > 2 * s->num_buckets)
+        {
+            for (size_t i = 0; i < s->num_buckets; i++)
+            {
+                sweep_bucket(s, i, now);
+            }
+            if (s->count > 2 * s->num_buckets)
+            {
+                grow(s);
+            }
+        }
+
+        pthread_mutex_unlock(&s->lock);
+        return CACHE_MISS;
+    }
+
+    if (e->expires <= now_ns())
+    {
+        e->state = ENTRY_PENDING; // refresh, later callers wait for this lookup
+        pthread_mutex_unlock(&s->lock);
+        return CACHE_MISS;
+    }
+
+    int result = CACHE_NOT_RESOLVED;
+    if (e->state == ENTRY_RESOLVED)
+    {
+        snprintf(ip, size, "%s", e->ip);
+        result = CACHE_RESOLVED;
+    }
+
+    pthread_mutex_unlock(&s->lock);
+
+    return result;
+}
+
+/*
+Looks a hostname up in the cache.
+
+Expects four arguments:
+1. Address of res_cache struct
+2. The hostname
+3. A buffer that receives the cached address
+4. The size of that buffer
+
+If another thread is resolving the same name, waits for its result
+rather than starting a second lookup.
+
+Returns CACHE_RESOLVED or CACHE_NOT_RESOLVED for a valid cached result.
+Returns CACHE_MISS if the name is unknown or its result expired; the
+name is then marked pending and the caller must resolve it and report
+the outcome with cache_fill() or cache_abandon(), or other threads
+wait forever.
+*/
+int cache_lookup(res_cache *c, const char *name, char *ip, int size)
+{
+    return lookup_entry(c, name, ip, size, true);
+}
+
+/*
+Like cache_lookup(), but returns CACHE_PENDING rather than waiting
+when another thread is resolving the name. Used by threads that
+have lookups of their own in flight and so must not block.
+The caller may resolve the name itself but must not call cache_fill().
+*/
+int cache_try_lookup(res_cache *c, const char *name, char *ip, int size)
+{
+    return lookup_entry(c, name, ip, size, false);
+}
+
+/*
+Stores the outcome of a lookup started after cache_lookup()
+returned CACHE_MISS, and wakes threads waiting for it.
+
+Expects three arguments:
+1. Address of res_cache struct
+2. The hostname
+3. The resolved address, or NULL if the lookup failed
+*/
+void cache_fill(res_cache *c, const char *name, const char *ip)
+{
+    uint64_t hash = hash_name(name);
+    cache_shard *s = shard_of(c, hash);
+
+    pthread_mutex_lock(&s->lock);
+
+    cache_entry *e = find(s, name, hash);
+    if (e != NULL)
+    {
+        if (ip != NULL)
+        {
+            snprintf(e->ip, sizeof(e->ip), "%s", ip);
+            e->state = ENTRY_RESOLVED;
+        }
+        else
+        {
+            e->state = ENTRY_FAILED;
+        }
+        e->expires = now_ns() + c->ttl;
+
+        pthread_cond_broadcast(&s->done);
+    }
+
+    pthread_mutex_unlock(&s->lock);
+}
+
+/*
+Gives up a lookup started after cache_lookup() returned CACHE_MISS
+without storing its outcome, for failures that say nothing about the
+name such as timeouts. The entry is left expired, so the next thread
+to look the name up, waiting or not, resolves it again.
+
+Expects two arguments:
+1. Address of res_cache struct
+2. The hostname
+*/
+void cache_abandon(res_cache *c, const char *name)
+{
+    uint64_t hash = hash_name(name);
+    cache_shard *s = shard_of(c, hash);
+
+    pthread_mutex_lock(&s->lock);
+
+    cache_entry *e = find(s, name, hash);
+    if (e != NULL)
+    {
+        e->state = ENTRY_FAILED;
+        e->expires = 0;
+
+        pthread_cond_broadcast(&s->done);
+    }
+
+    pthread_mutex_unlock(&s->lock);
+}
+
+/*
+Used to free every entry and the buckets of each shard.
+
+Returns 0 on success.
+*/
+int de_init_cache(res_cache *c)
+{
+    for (int i = 0; i < CACHE_SHARDS; i++)
+    {
+        cache_shard *s = &c->shards[i];
+        for (size_t b = 0; b < s->num_buckets; b++)
+        {
+            cache_entry *e = s->buckets[b];
+            while (e != NULL)
+            {
+                cache_entry *next = e->next;
+                free(e);
+                e = next;
+            }
+        }
+
+        free(s->buckets);
+        pthread_mutex_destroy(&s->lock);
+        pthread_cond_destroy(&s->done);
+    }
+
+    return 0;
+}
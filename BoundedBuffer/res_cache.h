@@ -0,0 +1,99 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+A header file used to implement a concurrent cache
+of hostname resolution results.
+*/
+
+#ifndef RES_CACHE_H
+#define RES_CACHE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <arpa/inet.h>
+
+#define CACHE_SHARDS 64            // independently locked parts of the cache, a power of two
+#define CACHE_INITIAL_BUCKETS 256  // per shard, doubled as the shard fills
+#define CACHE_MAX_ENTRIES (1 << 14) // per shard, beyond it older results are evicted
+#define CACHE_IP_LENGTH INET6_ADDRSTRLEN
+
+/*
+Returned by cache_lookup()
+*/
+#define CACHE_MISS 0         // caller must resolve the name and call cache_fill() or cache_abandon()
+#define CACHE_RESOLVED 1     // ip holds the cached address
+#define CACHE_NOT_RESOLVED 2 // the name recently failed to resolve
+#define CACHE_PENDING 3      // another thread is resolving the name (cache_try_lookup() only)
+
+typedef enum
+{
+    ENTRY_PENDING, // a thread is resolving the name right now
+    ENTRY_RESOLVED,
+    ENTRY_FAILED
+} entry_state;
+
+/*
+Declare a struct of type cache_entry that holds the result for
+one hostname. Entries of a bucket are chained through next.
+*/
+typedef struct cache_entry
+{
+    struct cache_entry *next;
+    uint64_t hash;
+    uint64_t expires; // CLOCK_MONOTONIC nanoseconds
+    entry_state state;
+    char ip[CACHE_IP_LENGTH];
+    char name[];
+} cache_entry;
+
+/*
+Declare a struct of type cache_shard, a chained hash table
+guarded by its own mutex.
+
+Threads that find an ENTRY_PENDING entry wait on done, which is
+broadcast whenever a lookup in the shard completes. This way
+concurrent requests for one name share a single lookup.
+
+Expired entries are removed from a bucket when a name is added to
+it, and from the whole shard before it grows. A shard holding
+CACHE_MAX_ENTRIES evicts a result for every new name, so a long
+running daemon keeps bounded memory. hand is the bucket the next
+eviction starts looking in.
+*/
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    cache_entry **buckets;
+    size_t num_buckets, count;
+    size_t hand;
+} cache_shard;
+
+/*
+Declare a struct of type res_cache that spreads hostnames over
+CACHE_SHARDS shards by hash, so threads resolving different names
+rarely contend for the same lock.
+
+Both addresses and failures (negative caching of NOT_RESOLVED)
+are kept for ttl nanoseconds after the lookup completed, unless a
+full shard evicts them sooner.
+*/
+typedef struct
+{
+    cache_shard shards[CACHE_SHARDS];
+    uint64_t ttl;
+} res_cache;
+
+uint64_t hash_name(const char *name);
+uint64_t hash_name_n(const char *name, size_t len);
+int init_cache(res_cache *c, int ttl_seconds);
+int cache_lookup(res_cache *c, const char *name, char *ip, int size);
+int cache_try_lookup(res_cache *c, const char *name, char *ip, int size);
+void cache_fill(res_cache *c, const char *name, const char *ip);
+void cache_abandon(res_cache *c, const char *name);
+int de_init_cache(res_cache *c);
+
+#endif
@@ -0,0 +1,527 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+Implementation of the interchangeable backends
+that resolve a hostname to an address.
+
+system    getaddrinfo(), the resolver configured on the machine
+hosts     a static table loaded from a hosts(5) style file
+sim       an offline simulator with deterministic addresses,
+          configurable latency, failure rate and transient
+          failure rate
+*/
+
+#include "resolver.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+/*
+Declare a struct of type host_entry, one name of a hosts file line
+*/
+typedef struct
+{
+    char *name; // NULL marks an empty slot
+    char ip[INET6_ADDRSTRLEN];
+} host_entry;
+
+/*
+Declare a struct of type hosts_table, an open addressing hash table
+that is only read once loaded, so lookups need no locking.
+*/
+typedef struct
+{
+    host_entry *slots;
+    size_t mask, count;
+} hosts_table;
+
+/*
+Declare a struct of type sim_config holding the options of the
+simulated backend, see init_resolver().
+*/
+typedef struct
+{
+    sim_dist dist;
+    double mean_ms;
+    double fail;
+    double again; // chance of a transient failure, drawn on every call
+    uint64_t seed;
+} sim_config;
+
+/*
+splitmix64 finalizer, spreads every input bit over the result
+*/
+static uint64_t mix(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+
+    return x ^ (x >> 31);
+}
+
+/*
+FNV-1a hash of a hostname, ignoring case as DNS does
+*/
+static uint64_t hash_lower(const char *name)
+{
+    uint64_t h = 14695981039346656037ULL;
+
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++)
+    {
+        h ^= tolower(*p);
+        h *= 1099511628211ULL;
+    }
+
+    return h;
+}
+
+/*
+Maps 64 random bits to a double in [0, 1)
+*/
+static double unit(uint64_t bits)
+{
+    return (bits >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int system_lookup(resolver *r, const char *hostname, char *ip, int size)
+{
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *result;
+    (void)r;
+
+    int err = getaddrinfo(hostname, NULL, &hints, &result);
+    if (err != 0)
+    {
+        return err == EAI_AGAIN ? RESOLVER_AGAIN : RESOLVER_FAILURE;
+    }
+
+    const void *addr;
+    if (result->ai_family == AF_INET)
+    {
+        addr = &((struct sockaddr_in *)result->ai_addr)->sin_addr;
+    }
+    else
+    {
+        addr = &((struct sockaddr_in6 *)result->ai_addr)->sin6_addr;
+    }
+
+    const char *written = inet_ntop(result->ai_family, addr, ip, size);
+    freeaddrinfo(result);
+
+    return written != NULL ? RESOLVER_SUCCESS : RESOLVER_FAILURE;
+}
+
+static void system_destroy(resolver *r)
+{
+    (void)r;
+}
+
+/*
+Returns the slot holding name, or the empty slot where it belongs
+*/
+static host_entry *hosts_slot(hosts_table *t, const char *name)
+{
+    size_t i = hash_lower(name) & t->mask;
+
+    while (t->slots[i].name != NULL && strcasecmp(t->slots[i].name, name) != 0)
+    {
+        i = (i + 1) & t->mask;
+    }
+
+    return &t->slots[i];
+}
+
+/*
+Adds name unless it is already present, the first line that
+mentions a name wins as in /etc/hosts. Doubles the table once
+it is half full.
+
+Returns 0 on success, -1 if memory is exhausted.
+*/
+static int hosts_insert(hosts_table *t, const char *name, const char *ip)
+{
+    if (2 * (t->count + 1) > t->mask + 1)
+    {
+        hosts_table bigger = {.mask = 2 * t->mask + 1, .count = t->count};
+        bigger.slots = calloc(bigger.mask + 1, sizeof(host_entry));
+        if (bigger.slots == NULL)
+        {
+            return -1;
+        }
+
+        for (size_t i = 0; i <= t->mask; i++)
+        {
+            if (t->slots[i].name != NULL)
+            {
+                *hosts_slot(&bigger, t->slots[i].name) = t->slots[i];
+            }
+        }
+
+        free(t->slots);
+        *t = bigger;
+    }
+
+    host_entry *e = hosts_slot(t, name);
+    if (e->name == NULL)
+    {
+        e->name = strdup(name);
+        if (e->name == NULL)
+        {
+            return -1;
+        }
+        snprintf(e->ip, sizeof(e->ip), "%s", ip);
+        t->count++;
+    }
+
+    return 0;
+}
+
+/*
+Loads "address name [alias ...]" lines, ignoring # comments and
+lines whose address is neither IPv4 nor IPv6.
+
+Returns 0 on success, -1 if the file could not be read.
+*/
+static int hosts_load(hosts_table *t, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    char *line = NULL;
+    size_t len = 0;
+    unsigned char addr[sizeof(struct in6_addr)];
+    int status = 0;
+
+    if (f == NULL)
+    {
+        return -1;
+    }
+
+    while (status == 0 && getline(&line, &len, f) != -1)
+    {
+        char *save;
+        char *hash = strchr(line, '#');
+        if (hash != NULL)
+        {
+            *hash = '\0';
+        }
+
+        char *ip = strtok_r(line, " \t\r\n", &save);
+        if (ip == NULL || (inet_pton(AF_INET, ip, addr) != 1 && inet_pton(AF_INET6, ip, addr) != 1))
+        {
+            continue;
+        }
+
+        char *name;
+        while (status == 0 && (name = strtok_r(NULL, " \t\r\n", &save)) != NULL)
+        {
+            status = hosts_insert(t, name, ip);
+        }
+    }
+
+    free(line);
+    fclose(f);
+
+    return status;
+}
+
+static int hosts_lookup(resolver *r, const char *hostname, char *ip, int size)
+{
+    host_entry *e = hosts_slot(r->state, hostname);
+
+    if (e->name == NULL)
+    {
+        return RESOLVER_FAILURE;
+    }
+
+    snprintf(ip, size, "%s", e->ip);
+
+    return RESOLVER_SUCCESS;
+}
+
+static void hosts_destroy(resolver *r)
+{
+    hosts_table *t = r->state;
+
+    for (size_t i = 0; i <= t->mask; i++)
+    {
+        free(t->slots[i].name);
+    }
+    free(t->slots);
+    free(t);
+}
+
+/*
+Returns 64 random bits from a generator private to the calling thread.
+*/
+static uint64_t sim_random(sim_config *cfg)
+{
+    static __thread uint64_t state;
+
+    if (state == 0)
+    {
+        state = mix(cfg->seed ^ (uintptr_t)&state);
+    }
+    state = mix(state);
+
+    return state;
+}
+
+/*
+Draws the latency of one simulated lookup in nanoseconds. Every call
+draws afresh.
+*/
+static uint64_t sim_latency(sim_config *cfg)
+{
+    double u = unit(sim_random(cfg));
+    double ms;
+
+    switch (cfg->dist)
+    {
+    case SIM_UNIFORM:
+        ms = 2.0 * cfg->mean_ms * u;
+        break;
+    case SIM_EXP:
+        ms = -cfg->mean_ms * log(1.0 - u);
+        break;
+    case SIM_PARETO:
+        // shape 1.5, scale chosen so the mean is mean_ms
+        ms = (cfg->mean_ms / 3.0) / pow(1.0 - u, 1.0 / 1.5);
+        break;
+    default:
+        ms = cfg->mean_ms;
+        break;
+    }
+
+    return (uint64_t)(ms * 1000000.0);
+}
+
+/*
+Whether a name resolves and to which address depends only on the
+name and the seed, so runs can be compared line by line. Addresses
+come from 198.18.0.0/15, the range reserved for benchmarks.
+*/
+static int sim_lookup(resolver *r, const char *hostname, char *ip, int size)
+{
+    sim_config *cfg = r->state;
+    uint64_t h = mix(hash_lower(hostname) ^ cfg->seed);
+    uint64_t ns = sim_latency(cfg);
+
+    if (ns > 0)
+    {
+        struct timespec ts = {.tv_sec = ns / 1000000000ULL, .tv_nsec = ns % 1000000000ULL};
+        while (nanosleep(&ts, &ts) != 0)
+        {
+            ; // resume after a signal
+        }
+    }
+
+    if (unit(mix(h)) < cfg->fail)
+    {
+        return RESOLVER_FAILURE;
+    }
+
+    if (cfg->again > 0 && unit(sim_random(cfg)) < cfg->again)
+    {
+        return RESOLVER_AGAIN;
+    }
+
+    snprintf(ip, size, "198.%u.%u.%u", 18 + (unsigned)(h & 1), (unsigned)(h >> 8) & 0xff, (unsigned)(h >> 16) & 0xff);
+
+    return RESOLVER_SUCCESS;
+}
+
+static void sim_destroy(resolver *r)
+{
+    free(r->state);
+}
+
+/*
+Parses the comma separated key=value options of the simulated backend:
+dist=const|uniform|exp|pareto, mean=<ms>, fail=<probability>,
+again=<probability>, seed=<n>
+
+Returns 0 on success, -1 on an unknown key or value.
+*/
+static int sim_parse(sim_config *cfg, const char *options)
+{
+    char buf[256];
+    char *save;
+
+    snprintf(buf, sizeof(buf), "%s", options);
+    for (char *opt = strtok_r(buf, ",", &save); opt != NULL; opt = strtok_r(NULL, ",", &save))
+    {
+        char *value = strchr(opt, '=');
+        if (value == NULL)
+        {
+            return -1;
+        }
+        *value++ = '\0';
+
+        if (strcmp(opt, "dist") == 0)
+        {
+            if (strcmp(value, "const") == 0)
+            {
+                cfg->dist = SIM_CONST;
+            }
+            else if (strcmp(value, "uniform") == 0)
+            {
+                cfg->dist = SIM_UNIFORM;
+            }
+            else if (strcmp(value, "exp") == 0)
+            {
+                cfg->dist = SIM_EXP;
+            }
+            else if (strcmp(value, "pareto") == 0)
+            {
+                cfg->dist = SIM_PARETO;
+            }
+            else
+            {
+                return -1;
+            }
+        }
+        else if (strcmp(opt, "mean") == 0)
+        {
+            cfg->mean_ms = atof(value);
+        }
+        else if (strcmp(opt, "fail") == 0)
+        {
+            cfg->fail = atof(value);
+        }
+        else if (strcmp(opt, "again") == 0)
+        {
+            cfg->again = atof(value);
+        }
+        else if (strcmp(opt, "seed") == 0)
+        {
+            cfg->seed = strtoull(value, NULL, 10);
+        }
+        else
+        {
+            return -1;
+        }
+    }
+
+    return cfg->mean_ms >= 0 && cfg->fail >= 0 && cfg->fail <= 1 && cfg->again >= 0 && cfg->again <= 1 ? 0 : -1;
+}
+
+/*
+Intended to be called once by the calling program.
+
+Expects two arguments:
+1. Address of resolver struct
+2. The backend to use, one of
+   system
+   hosts:<file>
+   sim[:dist=const|uniform|exp|pareto,mean=<ms>,fail=<probability>,again=<probability>,seed=<n>]
+   The simulator defaults to a constant 1ms, no failures and seed 0.
+   Names fail with probability fail always, and any lookup fails
+   transiently (RESOLVER_AGAIN) with probability again.
+
+Returns 0 on success, -1 if spec is invalid or the backend could
+not be set up.
+*/
+int init_resolver(resolver *r, const char *spec)
+{
+    if (strcmp(spec, "system") == 0)
+    {
+        r->name = "system";
+        r->lookup = system_lookup;
+        r->destroy = system_destroy;
+        r->state = NULL;
+        return 0;
+    }
+
+    if (strncmp(spec, "hosts:", 6) == 0)
+    {
+        hosts_table *t = malloc(sizeof(hosts_table));
+        if (t == NULL)
+        {
+            return -1;
+        }
+        t->mask = 63;
+        t->count = 0;
+        t->slots = calloc(t->mask + 1, sizeof(host_entry));
+
+        r->name = "hosts";
+        r->lookup = hosts_lookup;
+        r->destroy = hosts_destroy;
+        r->state = t;
+
+        if (t->slots == NULL || hosts_load(t, spec + 6) != 0)
+        {
+            hosts_destroy(r);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (strcmp(spec, "sim") == 0 || strncmp(spec, "sim:", 4) == 0)
+    {
+        sim_config *cfg = malloc(sizeof(sim_config));
+        if (cfg == NULL)
+        {
+            return -1;
+        }
+        cfg->dist = SIM_CONST;
+        cfg->mean_ms = 1.0;
+        cfg->fail = 0.0;
+        cfg->again = 0.0;
+        cfg->seed = 0;
+
+        if (spec[3] == ':' && sim_parse(cfg, spec + 4) != 0)
+        {
+            free(cfg);
+            return -1;
+        }
+
+        r->name = "sim";
+        r->lookup = sim_lookup;
+        r->destroy = sim_destroy;
+        r->state = cfg;
+        return 0;
+    }
+
+    return -1;
+}
+
+/*
+Resolves hostname with the selected backend.
+
+Expects four arguments:
+1. Address of resolver struct
+2. The hostname
+3. A buffer that receives the first address as text
+4. The size of that buffer
+
+Returns RESOLVER_SUCCESS, RESOLVER_FAILURE if the name could not be
+resolved, or RESOLVER_AGAIN if the failure was temporary, e.g. the
+name server could not be reached. Only RESOLVER_SUCCESS and
+RESOLVER_FAILURE are answers about the name. Callers should retry
+RESOLVER_AGAIN, as an attempt pool does (see attempt.c), or report
+the name as not resolved without caching the failure.
+*/
+int resolver_lookup(resolver *r, const char *hostname, char *ip, int size)
+{
+    return r->lookup(r, hostname, ip, size);
+}
+
+/*
+Used to release the state of the backend.
+
+Returns 0 on success.
+*/
+int de_init_resolver(resolver *r)
+{
+    r->destroy(r);
+
+    return 0;
+}
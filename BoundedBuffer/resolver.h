@@ -0,0 +1,52 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+A header file used to implement the interchangeable
+backends that resolve a hostname to an address.
+*/
+
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include <stdint.h>
+#include <arpa/inet.h>
+
+#define RESOLVER_SUCCESS 0
+#define RESOLVER_FAILURE -1
+#define RESOLVER_AGAIN -2 // a temporary failure, trying again may succeed
+
+/*
+Latency distributions of the simulated backend
+*/
+typedef enum
+{
+    SIM_CONST,   // every lookup takes mean
+    SIM_UNIFORM, // uniform between 0 and twice the mean
+    SIM_EXP,     // exponential with the given mean
+    SIM_PARETO   // heavy tailed (shape 1.5) with the given mean
+} sim_dist;
+
+/*
+Declare a struct of type resolver, a backend selected at start up.
+
+lookup() writes the first address of hostname to ip and returns
+RESOLVER_SUCCESS, RESOLVER_FAILURE if it could not be resolved, or
+RESOLVER_AGAIN if the failure was temporary.
+It may be called by many threads at once.
+destroy() releases whatever state the backend keeps in state.
+*/
+typedef struct resolver
+{
+    const char *name;
+    int (*lookup)(struct resolver *r, const char *hostname, char *ip, int size);
+    void (*destroy)(struct resolver *r);
+    void *state;
+} resolver;
+
+int init_resolver(resolver *r, const char *spec);
+int resolver_lookup(resolver *r, const char *hostname, char *ip, int size);
+int de_init_resolver(resolver *r);
+
+#endif
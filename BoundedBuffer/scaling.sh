@@ -0,0 +1,80 @@
+#!/bin/sh
+#
+# AUTHOR JOHN HARRINGTON
+#
+# PROGRAMMING ASSIGNMENT 3 PART A
+#
+# End-to-end scaling benchmark of multi-lookup. Generates a
+# reproducible input set with gen_names, then runs multi-lookup
+# against the offline sim resolver for thread counts 1, 2, 4, ...
+# up to MAX_THREADS and prints a CSV line per run, the fastest of
+# REPEAT runs each.
+#
+# By default requesters and resolvers grow together. With
+# SWEEP=requesters or SWEEP=resolvers only that side grows and the
+# other stays at FIXED_THREADS.
+#
+# Usage: ./scaling.sh [extra multi-lookup options ...]
+# e.g.   MAX_THREADS=64 NAMES=2000000 ./scaling.sh -m -S 8 > scaling.csv
+
+set -e
+
+MAX_THREADS=${MAX_THREADS:-$(nproc)}
+FIXED_THREADS=${FIXED_THREADS:-4}
+SWEEP=${SWEEP:-both}
+NAMES=${NAMES:-200000}
+FILES=${FILES:-16}
+DUPLICATES=${DUPLICATES:-0.3}
+SKEW=${SKEW:-1.0}
+BACKEND=${BACKEND:-sim:mean=0}
+REPEAT=${REPEAT:-3}
+DATA=${DATA:-scaling-data}
+
+cd "$(dirname "$0")"
+make -s multi-lookup gen_names
+
+mkdir -p "$DATA"
+if [ ! -f "$DATA/names1.txt" ]; then
+    ./gen_names -n "$NAMES" -f "$FILES" -d "$DUPLICATES" -z "$SKEW" -o "$DATA/names" >&2
+fi
+
+echo "requesters,resolvers,names,seconds,names_per_sec,speedup"
+
+base=""
+threads=1
+while [ "$threads" -le "$MAX_THREADS" ]; do
+    case "$SWEEP" in
+    requesters) req=$threads; res=$FIXED_THREADS ;;
+    resolvers) req=$FIXED_THREADS; res=$threads ;;
+    *) req=$threads; res=$threads ;;
+    esac
+
+    best=""
+    i=0
+    while [ "$i" -lt "$REPEAT" ]; do
+        seconds=$(./multi-lookup -b "$BACKEND" "$@" "$req" "$res" "$DATA/req.txt" "$DATA/res.txt" "$DATA"/names*.txt |
+            sed -n 's/.*total time is \([0-9.]*\) seconds/\1/p')
+        if [ -z "$seconds" ]; then
+            echo "multi-lookup failed with $req requesters and $res resolvers" >&2
+            exit 1
+        fi
+        if [ -z "$best" ] || awk "BEGIN { exit !($seconds < $best) }"; then
+            best=$seconds
+        fi
+        i=$((i + 1))
+    done
+
+    names=$(wc -l < "$DATA/res.txt")
+    base=${base:-$best}
+    awk -v req="$req" -v res="$res" -v names="$names" -v s="$best" -v base="$base" \
+        'BEGIN { printf "%d,%d,%d,%.3f,%.0f,%.2f\n", req, res, names, s, (s > 0 ? names / s : 0), (s > 0 ? base / s : 0) }'
+
+    # the last step is MAX_THREADS itself, also when it is not a power of two
+    if [ "$threads" -lt "$MAX_THREADS" ] && [ $((threads * 2)) -gt "$MAX_THREADS" ]; then
+        threads=$MAX_THREADS
+    else
+        threads=$((threads * 2))
+    fi
+done
+
+rm -f "$DATA/req.txt" "$DATA/res.txt"
@@ -0,0 +1,252 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+Implementation of a queue made of several
+independent fifos, with work stealing.
+*/
+
+#include "shard_queue.h"
+#include <stdlib.h>
+
+#define SORT_BATCH 64 // items routed per pass of shard_put_n()
+
+/*
+Expects four arguments:
+1. a pointer to a shard_queue struct
+2. the number of fifos, at most MAX_SHARDS
+3. the capacity of the whole queue, divided evenly among the fifos
+4. FIFO_LOCK_FREE or FIFO_ADAPTIVE, how consumers wait on a fifo
+
+Returns 0 on success, -1 if memory could not be allocated
+*/
+int init_shards(shard_queue *s, int num_shards, int capacity, fifo_mode mode)
+{
+    int each = (capacity + num_shards - 1) / num_shards;
+
+    s->shards = calloc(num_shards, sizeof(fifo));
+    if (s->shards == NULL)
+    {
+        return -1;
+    }
+
+    s->capacity = 0;
+    for (s->num_shards = 0; s->num_shards < num_shards; s->num_shards++)
+    {
+        if (init_q(&s->shards[s->num_shards], each, mode) != 0)
+        {
+            de_init_shards(s);
+            return -1;
+        }
+        s->capacity += s->shards[s->num_shards].capacity;
+    }
+
+    s->next_home = 0;
+    s->steals = 0;
+
+    return 0;
+}
+
+/*
+Returns the home shard of a new consumer, the shards are handed
+out in turn.
+*/
+int shard_home(shard_queue *s)
+{
+    return __atomic_fetch_add(&s->next_home, 1, __ATOMIC_RELAXED) % s->num_shards;
+}
+
+/*
+Expects four arguments:
+1. a pointer to a shard_queue struct
+2. the items to enqueue
+3. a key for every item, which selects its shard
+4. the number of items
+
+Items with the same key go to the same fifo, in the order given.
+Each fifo receives its items with a single en_q_n() per pass over
+up to SORT_BATCH items.
+
+Returns 0 on success, FIFO_CLOSED if the queue has been closed
+*/
+int shard_put_n(shard_queue *s, void **items, const uint64_t *keys, int n)
+{
+    if (s->num_shards == 1)
+    {
+        return en_q_n(&s->shards[0], items, n);
+    }
+
+    for (int done = 0; done < n; done += SORT_BATCH)
+    {
+        int count = n - done < SORT_BATCH ? n - done : SORT_BATCH;
+        int start[MAX_SHARDS + 1] = {0};
+        unsigned char shard[SORT_BATCH];
+        void *sorted[SORT_BATCH];
+
+        // counting sort by shard, stable so each shard keeps the input order
+        for (int i = 0; i < count; i++)
+        {
+            shard[i] = keys[done + i] % s->num_shards;
+            start[shard[i] + 1]++;
+        }
+        for (int k = 0; k < s->num_shards; k++)
+        {
+            start[k + 1] += start[k];
+        }
+
+        int fill[MAX_SHARDS];
+        for (int k = 0; k < s->num_shards; k++)
+        {
+            fill[k] = start[k];
+        }
+        for (int i = 0; i < count; i++)
+        {
+            sorted[fill[shard[i]]++] = items[done + i];
+        }
+
+        for (int k = 0; k < s->num_shards; k++)
+        {
+            if (start[k + 1] > start[k] && en_q_n(&s->shards[k], sorted + start[k], start[k + 1] - start[k]) != 0)
+            {
+                return FIFO_CLOSED;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+Enqueues one item on a given shard.
+
+Returns 0 on success, FIFO_CLOSED if the queue has been closed
+*/
+int shard_put(shard_queue *s, int shard, void *item)
+{
+    return en_q(&s->shards[shard % s->num_shards], item);
+}
+
+/*
+Takes up to max items from the other shards, without blocking.
+
+Returns the number of items taken, FIFO_AGAIN if all are empty,
+or FIFO_CLOSED once every one of them is closed and drained.
+*/
+static int steal(shard_queue *s, int home, void **out, int max)
+{
+    bool closed = true;
+
+    for (int i = 1; i < s->num_shards; i++)
+    {
+        int got = try_de_q_n(&s->shards[(home + i) % s->num_shards], out, max);
+
+        if (got > 0)
+        {
+            __atomic_add_fetch(&s->steals, 1, __ATOMIC_RELAXED);
+            return got;
+        }
+        closed &= got == FIFO_CLOSED;
+    }
+
+    return closed ? FIFO_CLOSED : FIFO_AGAIN;
+}
+
+/*
+Like try_de_q_n() on the whole queue: takes up to max items from
+the home shard, or else from another one.
+
+Returns the number of items taken, FIFO_AGAIN if every shard is
+empty, or FIFO_CLOSED once the queue is closed and drained.
+*/
+int shard_try_take(shard_queue *s, int home, void **out, int max)
+{
+    int got = try_de_q_n(&s->shards[home], out, max);
+
+    if (got > 0 || s->num_shards == 1)
+    {
+        return got;
+    }
+
+    int stolen = steal(s, home, out, max);
+    if (stolen == FIFO_CLOSED && got != FIFO_CLOSED)
+    {
+        return FIFO_AGAIN;
+    }
+
+    return stolen;
+}
+
+/*
+Like de_q_n() on the whole queue: takes up to max items, from the
+home shard if it has any, else from another shard, and blocks while
+all are empty.
+
+Returns the number of items taken, or FIFO_CLOSED once close_shards()
+has been called and every shard has been drained.
+*/
+int shard_take(shard_queue *s, int home, void **out, int max)
+{
+    if (s->num_shards == 1)
+    {
+        return de_q_n(&s->shards[0], out, max);
+    }
+
+    for (;;)
+    {
+        int got = shard_try_take(s, home, out, max);
+        if (got != FIFO_AGAIN)
+        {
+            return got;
+        }
+
+        got = timed_de_q_n(&s->shards[home], out, max, SHARD_STEAL_MS);
+        if (got > 0)
+        {
+            return got;
+        }
+    }
+}
+
+/*
+Returns the number of items waiting in all shards, a hint only.
+*/
+int shard_size(shard_queue *s)
+{
+    int size = 0;
+
+    for (int i = 0; i < s->num_shards; i++)
+    {
+        size += q_size(&s->shards[i]);
+    }
+
+    return size;
+}
+
+/*
+Closes every shard. Intended to be called once, after every producer
+has returned from its last shard_put_n() or shard_put().
+*/
+void close_shards(shard_queue *s)
+{
+    for (int i = 0; i < s->num_shards; i++)
+    {
+        close_q(&s->shards[i]);
+    }
+}
+
+/*
+Expects as sole argument a pointer to a shard_queue struct
+
+Returns 0 on success
+*/
+int de_init_shards(shard_queue *s)
+{
+    for (int i = 0; i < s->num_shards; i++)
+    {
+        de_init_q(&s->shards[i]);
+    }
+    free(s->shards);
+
+    return 0;
+}
@@ -0,0 +1,48 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+A header file used to implement a queue made of
+several independent fifos, with work stealing.
+*/
+
+#ifndef SHARD_QUEUE_H
+#define SHARD_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "shared_array.h"
+
+#define MAX_SHARDS 64
+#define SHARD_STEAL_MS 2 // how long a consumer waits on its own shard before looking at the others again
+
+/*
+Declare a struct of type shard_queue, num_shards fifos that producers
+fill by key and consumers drain by preference from their own.
+
+Every consumer has a home shard. It takes from there while it can,
+steals from the other shards once its own runs dry, and otherwise
+blocks on its own for up to SHARD_STEAL_MS before looking again. With
+a single shard this is a plain fifo and nothing is ever stolen.
+*/
+typedef struct
+{
+    fifo *shards;
+    int num_shards;
+    size_t capacity; // over all shards
+    int next_home;   // hands out home shards round robin
+    uint64_t steals; // batches consumers took from a shard other than their own
+} shard_queue;
+
+int init_shards(shard_queue *s, int num_shards, int capacity, fifo_mode mode);
+int shard_home(shard_queue *s);
+int shard_put_n(shard_queue *s, void **items, const uint64_t *keys, int n);
+int shard_put(shard_queue *s, int shard, void *item);
+int shard_take(shard_queue *s, int home, void **out, int max);
+int shard_try_take(shard_queue *s, int home, void **out, int max);
+int shard_size(shard_queue *s);
+void close_shards(shard_queue *s);
+int de_init_shards(shard_queue *s);
+
+#endif
@@ -11,30 +11,505 @@ and logic to solve the bounded buffer problem.
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <sched.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#define WAIT_FOREVER -1
+
+/*
+Returns slot i of the buffer.
+*/
+static inline entry *slot_at(fifo *q, size_t i)
+{
+    return (entry *)(q->buffer + i * q->slot_size);
+}
+
+/*
+Copies an item of q->item_size bytes. Pointers, the common case, are
+copied with a fixed size memcpy(), which compiles to a single move.
+*/
+static inline void copy_item(fifo *q, void *to, const void *from)
+{
+    if (q->item_size == sizeof(void *))
+    {
+        memcpy(to, from, sizeof(void *));
+    }
+    else
+    {
+        memcpy(to, from, q->item_size);
+    }
+}
+
+/*
+Claims up to n slots at the tail of a FIFO_LOCK_FREE ring and copies
+the items into them.
+
+A slot is free for position pos when its sequence number equals pos.
+The producer counts how many consecutive slots from the tail are free,
+claims all of them with a single CAS on tail, writes the items and
+then publishes each slot by setting its sequence number to pos + 1.
+
+Returns the number of items stored, 0 if the slot at the tail has
+not been released by a consumer yet.
+*/
+static int ring_push_n(fifo *q, const char *items, int n)
+{
+    size_t pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+
+    for (;;)
+    {
+        int ready = 0;
+        while (ready < n)
+        {
+            entry *slot = slot_at(q, (pos + ready) & q->mask);
+            if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + ready)
+            {
+                break;
+            }
+            ready++;
+        }
+
+        if (ready == 0)
+        {
+            intptr_t dif = (intptr_t)__atomic_load_n(&slot_at(q, pos & q->mask)->seq, __ATOMIC_ACQUIRE) - (intptr_t)pos;
+            if (dif < 0)
+            {
+                return 0;
+            }
+
+            pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED); // another producer took this position
+            continue;
+        }
+
+        // on failure pos is reloaded with the current tail
+        if (__atomic_compare_exchange_n(&q->tail, &pos, pos + ready, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+            for (int i = 0; i < ready; i++)
+            {
+                entry *slot = slot_at(q, (pos + i) & q->mask);
+                copy_item(q, (char *)slot + q->item_offset, items + i * q->item_size);
+                __atomic_store_n(&slot->seq, pos + i + 1, __ATOMIC_RELEASE);
+            }
+            return ready;
+        }
+    }
+}
+
+/*
+Claims up to max slots at the head of a FIFO_LOCK_FREE ring and copies
+the items stored in them to out.
+
+A slot holds an entry for position pos when its sequence number equals
+pos + 1. After copying the item the consumer releases the slot for
+the producer one lap later by setting the sequence number to pos + capacity.
+
+Returns the number of items removed, 0 if the slot at the head has
+not been published by a producer yet.
+*/
+static int ring_pop_n(fifo *q, char *out, int max)
+{
+    size_t pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+
+    for (;;)
+    {
+        int ready = 0;
+        while (ready < max)
+        {
+            entry *slot = slot_at(q, (pos + ready) & q->mask);
+            if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + ready + 1)
+            {
+                break;
+            }
+            ready++;
+        }
+
+        if (ready == 0)
+        {
+            intptr_t dif = (intptr_t)__atomic_load_n(&slot_at(q, pos & q->mask)->seq, __ATOMIC_ACQUIRE) - (intptr_t)(pos + 1);
+            if (dif < 0)
+            {
+                return 0;
+            }
+
+            pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED); // another consumer took this position
+            continue;
+        }
+
+        if (__atomic_compare_exchange_n(&q->head, &pos, pos + ready, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+            for (int i = 0; i < ready; i++)
+            {
+                entry *slot = slot_at(q, (pos + i) & q->mask);
+                copy_item(q, out + i * q->item_size, (char *)slot + q->item_offset);
+                __atomic_store_n(&slot->seq, pos + i + q->capacity, __ATOMIC_RELEASE);
+            }
+            return ready;
+        }
+    }
+}
+
+/*
+Adds an item to the end of a FIFO_LOCKED queue.
+The caller must hold M and an EMPTY token.
+*/
+static void locked_push(fifo *q, const void *item)
+{
+    if (q->front == -1 && q->end == -1) // fifo is empty
+    {
+        q->front = 0;
+        q->end = 0;
+    }
+    else
+    {
+        q->end = (q->end + 1) & q->mask;
+    }
+
+    copy_item(q, (char *)slot_at(q, q->end) + q->item_offset, item);
+}
+
+/*
+Removes the item at the front of a FIFO_LOCKED queue.
+The caller must hold M.
+
+Returns false if the fifo is empty.
+*/
+static bool locked_pop(fifo *q, void *item)
+{
+    if (q->front == -1 && q->end == -1) // fifo is empty
+    {
+        return false;
+    }
+
+    copy_item(q, item, (char *)slot_at(q, q->front) + q->item_offset);
+
+    if (q->front == q->end) // one element remained in fifo
+    {
+        q->front = -1;
+        q->end = -1;
+    }
+    else
+    {
+        q->front = (q->front + 1) & q->mask;
+    }
+
+    return true;
+}
+
+/*
+Takes up to max tokens from semaphore s. Waits up to wait_ms
+milliseconds for the first one, forever if WAIT_FOREVER, then takes
+whatever else is immediately available without blocking.
+
+Returns the number of tokens taken, 0 only if the wait timed out.
+*/
+static int sem_take_n(sem_t *s, int max, int wait_ms)
+{
+    int taken = 1;
+
+    if (wait_ms == WAIT_FOREVER)
+    {
+        sem_wait(s);
+    }
+    else if (sem_trywait(s) != 0)
+    {
+        if (wait_ms == 0)
+        {
+            return 0;
+        }
+
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until); // the clock sem_timedwait() measures against
+        until.tv_sec += wait_ms / 1000;
+        until.tv_nsec += (wait_ms % 1000) * 1000000L;
+        if (until.tv_nsec >= 1000000000L)
+        {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+
+        while (sem_timedwait(s, &until) != 0)
+        {
+            if (errno != EINTR)
+            {
+                return 0;
+            }
+        }
+    }
+
+    while (taken < max && sem_trywait(s) == 0)
+    {
+        taken++;
+    }
+
+    return taken;
+}
+
+/*
+Returns n tokens to semaphore s.
+*/
+static void sem_give_n(sem_t *s, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        sem_post(s);
+    }
+}
+
+/*
+Tells the CPU the thread is spinning, which frees execution resources
+for a sibling hyperthread and avoids a pipeline flush when the spin
+ends.
+*/
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+/*
+Moves the spin limit of t towards target by an eighth of the distance,
+within FIFO_SPIN_MIN and FIFO_SPIN_MAX. Racing updates may lose one,
+which does no harm to an estimate.
+*/
+static void adapt_spin(fifo_tokens *t, int target)
+{
+    int spin = __atomic_load_n(&t->spin, __ATOMIC_RELAXED);
+
+    spin += (target - spin) / 8;
+    spin = spin < FIFO_SPIN_MIN ? FIFO_SPIN_MIN : spin > FIFO_SPIN_MAX ? FIFO_SPIN_MAX : spin;
+    __atomic_store_n(&t->spin, spin, __ATOMIC_RELAXED);
+}
+
+/*
+Takes up to max tokens from futex counter t, like sem_take_n(). Spins
+up to t->spin rounds for the first token before sleeping on the futex,
+unless wait_ms is 0.
+
+A sleeper announces itself in waiters before its last look at count,
+and a giver adds to count before it looks at waiters. Both are
+sequentially consistent, so either the sleeper sees the new tokens
+or the giver sees the sleeper and wakes it. FUTEX_WAIT itself only
+sleeps while count is still 0.
+
+Returns the number of tokens taken, 0 only if the wait timed out.
+*/
+static int futex_take_n(fifo_tokens *t, int max, int wait_ms)
+{
+    int limit = wait_ms == 0 ? 0 : __atomic_load_n(&t->spin, __ATOMIC_RELAXED);
+    int rounds = 0;
+    bool parked = false;
+    struct timespec until;
+
+    if (wait_ms > 0)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &until); // the clock FUTEX_WAIT measures against
+        until.tv_sec += wait_ms / 1000;
+        until.tv_nsec += (wait_ms % 1000) * 1000000L;
+        if (until.tv_nsec >= 1000000000L)
+        {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+    }
+
+    for (;;)
+    {
+        int count = __atomic_load_n(&t->count, __ATOMIC_RELAXED);
+        while (count > 0)
+        {
+            int n = count < max ? count : max;
+            if (__atomic_compare_exchange_n(&t->count, &count, count - n, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            {
+                if (rounds > 0 && !parked)
+                {
+                    adapt_spin(t, 2 * rounds); // spinning paid off, leave room for a slower wait next time
+                }
+                return n;
+            }
+        }
+
+        if (wait_ms == 0)
+        {
+            return 0;
+        }
+        if (rounds < limit)
+        {
+            cpu_relax();
+            rounds++;
+            continue;
+        }
+        if (!parked)
+        {
+            adapt_spin(t, FIFO_SPIN_MIN); // spun in vain
+            parked = true;
+        }
+
+        struct timespec left, *timeout = NULL;
+        if (wait_ms > 0)
+        {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            left.tv_sec = until.tv_sec - now.tv_sec;
+            left.tv_nsec = until.tv_nsec - now.tv_nsec;
+            if (left.tv_nsec < 0)
+            {
+                left.tv_sec--;
+                left.tv_nsec += 1000000000L;
+            }
+            if (left.tv_sec < 0)
+            {
+                return 0;
+            }
+            timeout = &left;
+        }
+
+        __atomic_add_fetch(&t->waiters, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&t->count, __ATOMIC_SEQ_CST) == 0)
+        {
+            syscall(SYS_futex, &t->count, FUTEX_WAIT_PRIVATE, 0, timeout, NULL, 0); // returns early on a wake, signal or new tokens
+        }
+        __atomic_sub_fetch(&t->waiters, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+Returns n tokens to futex counter t, and wakes up to n sleepers if
+there are any. With nobody asleep this is a single atomic add.
+*/
+static void futex_give_n(fifo_tokens *t, int n)
+{
+    __atomic_add_fetch(&t->count, n, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&t->waiters, __ATOMIC_SEQ_CST) > 0)
+    {
+        syscall(SYS_futex, &t->count, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+    }
+}
+
+/*
+Takes up to max tokens of FULL if full is set, otherwise of EMPTY,
+from the futex counters of a FIFO_ADAPTIVE fifo or the semaphores.
+See sem_take_n().
+*/
+static int take_tokens(fifo *q, bool full, int max, int wait_ms)
+{
+    if (q->mode == FIFO_ADAPTIVE)
+    {
+        return futex_take_n(full ? &q->full_tokens : &q->empty_tokens, max, wait_ms);
+    }
+
+    return sem_take_n(full ? &q->FULL : &q->EMPTY, max, wait_ms);
+}
+
+/*
+Returns n tokens of FULL if full is set, otherwise of EMPTY.
+*/
+static void give_tokens(fifo *q, bool full, int n)
+{
+    if (n == 0)
+    {
+        return;
+    }
+
+    if (q->mode == FIFO_ADAPTIVE)
+    {
+        futex_give_n(full ? &q->full_tokens : &q->empty_tokens, n);
+    }
+    else
+    {
+        sem_give_n(full ? &q->FULL : &q->EMPTY, n);
+    }
+}
 
 /*
 Intended to be called once by the calling program.
 
-Expects as sole argument an address of a fifo struct.
+Expects three arguments:
+1. Address of fifo struct
+2. The number of entries the fifo must hold, rounded up to a power of two
+3. The synchronization strategy to use (see fifo_mode in shared_array.h)
+
+The fifo carries pointers, see init_q_items().
+
+Returns 0 on success, -1 if capacity is out of range or the
+array could not be allocated.
+*/
+int init_q(fifo *q, int capacity, fifo_mode mode)
+{
+    return init_q_items(q, capacity, mode, sizeof(void *), __alignof__(void *));
+}
+
+/*
+Like init_q(), but the fifo carries items of item_size bytes rather
+than pointers. Expects two more arguments:
+4. The size of an item
+5. Its alignment, a power of two no larger than CACHE_LINE_SIZE
+
+Items are copied into and out of the slots, so a small record needs
+neither an allocation of its own nor a pointer chase to read it.
 
-Dynamically allocates an array of entry structs,
-the size of which is defined in shared_array.h.
+Dynamically allocates a cache line aligned array of slots.
 
-Initializes the front and end members.
+Initializes the front and end members, or the head and tail
+members and slot sequence numbers of a lock-free ring.
 
 Initializes the semaphore members.
 
-Returns 0 on success.
+Returns 0 on success, -1 if capacity, size or alignment are out of
+range or the array could not be allocated.
 */
-int init_q(fifo *q)
+int init_q_items(fifo *q, int capacity, fifo_mode mode, size_t item_size, size_t item_align)
 {
-    q->buffer = malloc(BUFFER_SIZE * sizeof(entry));
+    if (capacity < 1 || capacity > MAX_BUFFER_SIZE || item_size < 1 || item_align < 1 ||
+        item_align > CACHE_LINE_SIZE || (item_align & (item_align - 1)) != 0)
+    {
+        return -1;
+    }
+
+    if (item_align < __alignof__(entry)) // seq is read atomically, every slot must keep it aligned
+    {
+        item_align = __alignof__(entry);
+    }
+    q->item_size = item_size;
+    q->item_offset = (sizeof(entry) + item_align - 1) & ~(item_align - 1);
+    q->slot_size = (q->item_offset + item_size + item_align - 1) & ~(item_align - 1);
+
+    q->capacity = 1;
+    while (q->capacity < (size_t)capacity)
+    {
+        q->capacity <<= 1;
+    }
+    q->mask = q->capacity - 1;
+
+    if (posix_memalign((void **)&q->buffer, CACHE_LINE_SIZE, q->capacity * q->slot_size) != 0)
+    {
+        return -1;
+    }
+
     q->front = -1;
     q->end = -1;
-    q->used = false;
+    q->closed = false;
+    q->mode = mode;
+    q->head = 0;
+    q->tail = 0;
+    for (size_t i = 0; i < q->capacity; i++)
+    {
+        entry *slot = slot_at(q, i);
+        slot->seq = i; // slot i is free for ring position i
+        memset((char *)slot + q->item_offset, 0, item_size);
+    }
     sem_init(&q->M, 0, 1);
-    sem_init(&q->EMPTY, 0, BUFFER_SIZE);
+    sem_init(&q->EMPTY, 0, q->capacity);
     sem_init(&q->FULL, 0, 0);
+    q->empty_tokens = (fifo_tokens){.count = q->capacity, .waiters = 0, .spin = FIFO_SPIN_INITIAL};
+    q->full_tokens = (fifo_tokens){.count = 0, .waiters = 0, .spin = FIFO_SPIN_INITIAL};
 
     return 0;
 }
@@ -44,82 +519,308 @@ Adds an address to the queue.
 
 Expects two arguments:
 1. Address of fifo struct
-2. A c string representing the address to enqueue
+2. A pointer to enqueue, e.g. a hostname record or a filename
 
 A new entry struct will be created and added to the end
 of the queue.
 
-Returns 0 on success.
+Returns 0 on success, or FIFO_CLOSED if close_q() has
+already been called on the fifo.
 
 */
-int en_q(fifo *q, char *address)
+int en_q(fifo *q, void *address)
 {
-    sem_wait(&q->EMPTY); // decrements semaphore EMPTY beginning at BUFFER_SIZE, if 0 waits for item to be removed
-    sem_wait(&q->M);     // decrements M, enforcing mutual exclusion on the following CIS
+    return en_q_n(q, &address, 1);
+}
 
-    if (q->front == -1 && q->end == -1) // fifo is empty
-    {
-        q->front = 0;
-        q->end = 0;
+/*
+Adds n addresses to the queue, in order.
 
-        entry new;
-        new.address = address;
+Expects three arguments:
+1. Address of fifo struct
+2. An array of pointers to enqueue
+3. The number of addresses in the array
 
-        q->buffer[q->end] = new;
-    }
-    else
-    {
-        q->end = (q->end + 1) % BUFFER_SIZE;
+Each time the fifo has room, as many addresses as fit are moved
+with a single acquisition of M (FIFO_LOCKED) or a single CAS on
+tail (otherwise). Blocks while the fifo is full.
 
-        entry new;
-        new.address = address;
+Returns 0 once all n addresses are enqueued, or FIFO_CLOSED if
+close_q() has already been called on the fifo.
+*/
+int en_q_n(fifo *q, void **items, int n)
+{
+    return en_q_items(q, items, n);
+}
+
+/*
+Adds n items to the queue after taking EMPTY tokens for them with
+take_tokens(), waiting at most wait_ms milliseconds each time the
+fifo is full. Shared by en_q_items() and timed_en_q().
+
+Returns 0 once all n items are enqueued, FIFO_CLOSED if close_q() has
+already been called, or FIFO_AGAIN if the fifo stayed full for
+wait_ms milliseconds.
+*/
+static int put_entries(fifo *q, const void *items, int n, int wait_ms)
+{
+    const char *bytes = items;
 
-        q->buffer[q->end] = new;
+    if (__atomic_load_n(&q->closed, __ATOMIC_ACQUIRE))
+    {
+        return FIFO_CLOSED;
+    }
+
+    int done = 0;
+    while (done < n)
+    {
+        int room = take_tokens(q, false, n - done, wait_ms); // waits only if the fifo is full
+        if (room == 0)
+        {
+            return FIFO_AGAIN;
+        }
+
+        if (q->mode != FIFO_LOCKED)
+        {
+            // holding EMPTY tokens guarantees slots are being released,
+            // a slow consumer may just not have published them yet
+            int pushed = 0;
+            while (pushed < room)
+            {
+                int k = ring_push_n(q, bytes + (done + pushed) * q->item_size, room - pushed);
+                if (k == 0)
+                {
+                    sched_yield();
+                }
+                pushed += k;
+            }
+        }
+        else
+        {
+            sem_wait(&q->M); // enforce mutex on CIS
+            for (int i = 0; i < room; i++)
+            {
+                locked_push(q, bytes + (done + i) * q->item_size);
+            }
+            sem_post(&q->M); // release mutex on CIS
+        }
+
+        give_tokens(q, true, room); // wakes up to room consumers
+        done += room;
     }
-    q->used = true;
-    sem_post(&q->M);    // increments M, allowing blocked threads to access CIS
-    sem_post(&q->FULL); // increments FULL beginning at 0
 
     return 0;
 }
 
 /*
-Used to return the entry address stored at the front of the
+Like en_q_n(), for a fifo set up with init_q_items(): copies n items
+of the fifo's item size, stored one after another at items.
+*/
+int en_q_items(fifo *q, const void *items, int n)
+{
+    return put_entries(q, items, n, WAIT_FOREVER);
+}
+
+/*
+Like en_q(), but waits at most wait_ms milliseconds for room.
+
+Returns 0 on success, FIFO_AGAIN if the fifo stayed full that long,
+or FIFO_CLOSED if close_q() has already been called on the fifo.
+*/
+int timed_en_q(fifo *q, void *address, int wait_ms)
+{
+    return put_entries(q, &address, 1, wait_ms);
+}
+
+/*
+Used to remove the entry address stored at the front of the
 queue.
 
-Expects as sole argument an address of a fifo struct.
+Expects two arguments:
+1. Address of fifo struct
+2. Address of a pointer that receives the dequeued address
+
+Blocks while the fifo is empty and still open.
+
+Returns 0 on success, or FIFO_CLOSED once close_q() has been
+called and every entry has been dequeued.
 */
-char *de_q(fifo *q)
+int de_q(fifo *q, void **address)
 {
-    while (!q->used); // ensure queue has been pushed to one time 
+    return de_q_n(q, address, 1) == FIFO_CLOSED ? FIFO_CLOSED : 0;
+}
 
-    sem_wait(&q->M); // enforce mutex on CIS
+/*
+Removes up to max addresses from the front of the queue, after taking
+up to max FULL tokens with take_tokens(). Shared by de_q_n(),
+try_de_q_n() and timed_de_q_n().
 
-    if ((q->front == -1) && q->end == -1) // fifo is empty
+Returns the number of addresses dequeued, FIFO_CLOSED once the fifo
+is closed and drained, or FIFO_AGAIN if the fifo stayed empty for
+wait_ms milliseconds.
+*/
+static int take_entries(fifo *q, void *out, int max, int wait_ms)
+{
+    char *bytes = out;
+    int tokens = take_tokens(q, true, max, wait_ms); // waits only if the fifo is empty
+    int got = 0;
+
+    if (tokens == 0)
     {
+        return FIFO_AGAIN;
+    }
+
+    if (q->mode != FIFO_LOCKED)
+    {
+        // holding FULL tokens guarantees entries are being published,
+        // a slow producer may just not have finished writing them yet
+        while (got < tokens)
+        {
+            int k = ring_pop_n(q, bytes + got * q->item_size, tokens - got);
+
+            if (k == 0)
+            {
+                if (got > 0)
+                {
+                    break; // hand the remaining tokens back rather than wait
+                }
+
+                // every en_q has returned before close_q, so a closed ring
+                // that still comes up empty is drained
+                if (__atomic_load_n(&q->closed, __ATOMIC_ACQUIRE))
+                {
+                    got += ring_pop_n(q, bytes + got * q->item_size, tokens - got);
+                    break;
+                }
+
+                sched_yield();
+            }
+
+            got += k;
+        }
+    }
+    else
+    {
+        sem_wait(&q->M); // enforce mutex on CIS
+        while (got < tokens && locked_pop(q, bytes + got * q->item_size))
+        {
+            got++;
+        }
         sem_post(&q->M); // release mutex on CIS
-        return "empty";
     }
 
-    sem_wait(&q->FULL); // decrements FULL as an item is removed, if 0 waits for an item to be added
+    // tokens without an entry go back, this passes the close
+    // token on to the next consumer
+    give_tokens(q, true, tokens - got);
+    give_tokens(q, false, got);
+
+    return got > 0 ? got : FIFO_CLOSED;
+}
+
+/*
+Removes up to max addresses from the front of the queue, in order.
+
+Expects three arguments:
+1. Address of fifo struct
+2. An array that receives the dequeued addresses
+3. The capacity of that array
 
-    if (q->front == q->end) // one element remains in fifo
+Blocks while the fifo is empty and still open, then takes every
+entry that is available (up to max) with a single acquisition of
+M (FIFO_LOCKED) or a single CAS on head (otherwise).
+
+Returns the number of addresses dequeued, or FIFO_CLOSED once
+close_q() has been called and every entry has been dequeued.
+*/
+int de_q_n(fifo *q, void **out, int max)
+{
+    return take_entries(q, out, max, WAIT_FOREVER);
+}
+
+/*
+Like de_q_n(), but never blocks.
+
+Returns the number of addresses dequeued, FIFO_AGAIN if the fifo is
+currently empty, or FIFO_CLOSED once close_q() has been called and
+every entry has been dequeued.
+*/
+int try_de_q_n(fifo *q, void **out, int max)
+{
+    return take_entries(q, out, max, 0);
+}
+
+/*
+Like de_q_n(), but waits at most wait_ms milliseconds for an entry.
+
+Returns the number of addresses dequeued, FIFO_AGAIN if the fifo
+stayed empty that long, or FIFO_CLOSED once close_q() has been
+called and every entry has been dequeued.
+*/
+int timed_de_q_n(fifo *q, void **out, int max, int wait_ms)
+{
+    return take_entries(q, out, max, wait_ms);
+}
+
+/*
+Like de_q_n(), for a fifo set up with init_q_items(): copies up to
+max items to out, one after another.
+*/
+int de_q_items(fifo *q, void *out, int max)
+{
+    return take_entries(q, out, max, WAIT_FOREVER);
+}
+
+/*
+Like timed_de_q_n(), for a fifo set up with init_q_items(). A wait of
+0 never blocks.
+*/
+int timed_de_q_items(fifo *q, void *out, int max, int wait_ms)
+{
+    return take_entries(q, out, max, wait_ms);
+}
+
+/*
+Marks the fifo as closed. Intended to be called once, after
+every producer has returned from its last en_q().
+
+Consumers blocked in de_q() keep receiving entries until the fifo
+is drained, and then return FIFO_CLOSED.
+*/
+void close_q(fifo *q)
+{
+    if (__atomic_exchange_n(&q->closed, true, __ATOMIC_ACQ_REL))
     {
-        char *address = q->buffer[q->front].address;
-        q->front = -1;
-        q->end = -1;
-        sem_post(&q->M);     // release mutex on CIS
-        sem_post(&q->EMPTY); // increments EMPTY -> this value represents how many more items can be added
-        return address;
+        return; // already closed
+    }
+
+    give_tokens(q, true, 1); // close token, wakes one consumer that finds the fifo empty
+}
+
+/*
+Expects as sole argument a pointer to a fifo struct
+
+The count changes as soon as it has been read, use it as a hint only.
+
+Returns the number of entries waiting in the queue
+*/
+int q_size(fifo *q)
+{
+    int full;
+
+    if (q->mode == FIFO_ADAPTIVE)
+    {
+        full = __atomic_load_n(&q->full_tokens.count, __ATOMIC_RELAXED);
     }
     else
     {
-        char *address = q->buffer[q->front].address;
-        q->front = (q->front + 1) % BUFFER_SIZE;
-        sem_post(&q->M);     // release mutex on CIS
-        sem_post(&q->EMPTY); // increments EMPTY -> this value represents how many more items can be added
-        return address;
+        sem_getvalue(&q->FULL, &full);
+    }
+    if (__atomic_load_n(&q->closed, __ATOMIC_ACQUIRE) && full > 0)
+    {
+        full--; // the close token is not an entry
     }
+
+    return full > 0 ? full : 0;
 }
 
 /*
@@ -141,18 +842,32 @@ int de_init_q(fifo *q)
 /*
 Used to debug and test my implementation.
 
-Prints the address of each entry struct present
-in the fifo struct, to include null entry structs.
+Prints the pointer held by each slot present in the fifo
+struct, to include null pointers, or the bytes of each item
+when the fifo carries something else.
 
 Useful for checking what remains in the fifo after more is produced
 than what is consumed.
 */
 void print_q(fifo *q)
 {
-    printf("Buffer of size %d contains:\n", BUFFER_SIZE);
+    printf("Buffer of size %zu contains:\n", q->capacity);
 
-    for (int i = 0; i < BUFFER_SIZE; i++)
+    for (size_t i = 0; i < q->capacity; i++)
     {
-        printf("%s\n", q->buffer[i].address);
+        const unsigned char *item = (unsigned char *)slot_at(q, i) + q->item_offset;
+
+        if (q->item_size == sizeof(void *))
+        {
+            void *address;
+            memcpy(&address, item, sizeof(void *));
+            printf("%p\n", address);
+            continue;
+        }
+        for (size_t b = 0; b < q->item_size; b++)
+        {
+            printf("%02x", item[b]);
+        }
+        printf("\n");
     }
 }
\ No newline at end of file
@@ -15,66 +15,144 @@ and logic to solve the bounded buffer problem.
 #include <stdio.h>
 #include <stdbool.h>
 
-#define BUFFER_SIZE 10 // ARRAY_SIZE
+#define BUFFER_SIZE 256        // default capacity, see init_q()
+#define MAX_BUFFER_SIZE (1 << 24)
+#define CACHE_LINE_SIZE 64
+#define FIFO_CLOSED -1  // returned once a closed fifo has been drained
+#define FIFO_AGAIN -2   // returned by the try_ and timed_ calls when the fifo is empty, or full for timed_en_q()
+#define FIFO_SPIN_MIN 16      // pause rounds a FIFO_ADAPTIVE waiter spins at least before parking
+#define FIFO_SPIN_MAX 4096    // and at most, a few microseconds
+#define FIFO_SPIN_INITIAL 256
 
 /*
-Declare a struct of type entry that is capable of
-containing the address to resolve or filename.
+Selects the synchronization strategy used by a fifo.
+
+FIFO_LOCKED is the original bounded buffer: every en_q/de_q
+takes the mutex semaphore M around updates of front and end.
+
+FIFO_LOCK_FREE is a multi-producer/multi-consumer ring buffer.
+Each slot carries a sequence number, and producers and consumers
+claim positions with a compare-and-swap on tail and head
+respectively, so no lock is held while moving an entry.
+
+FIFO_ADAPTIVE is the same ring, but a thread that finds it full or
+empty first spins for a while with the pause instruction, and only
+then parks on a futex (see fifo_tokens). When entries come faster
+than a sleep and wakeup take, e.g. hostnames answered from the
+cache, no thread enters the kernel at all.
+*/
+typedef enum
+{
+    FIFO_LOCKED,
+    FIFO_LOCK_FREE,
+    FIFO_ADAPTIVE
+} fifo_mode;
+
+/*
+Declare a struct of type fifo_tokens, the counting semaphore a
+FIFO_ADAPTIVE fifo uses in place of EMPTY or FULL.
+
+Tokens are taken with a CAS on count. A thread that finds none spins
+up to spin pause rounds, then adds itself to waiters and sleeps on
+count with FUTEX_WAIT. Threads giving tokens only call FUTEX_WAKE
+while waiters is not 0, so as long as nobody sleeps neither side
+makes a system call.
+
+spin adapts to the load: it moves towards twice the rounds after
+which spinning paid off, and shrinks each time it did not, down to
+FIFO_SPIN_MIN when entries are far apart.
+*/
+typedef struct
+{
+    int count;   // tokens available, the futex word
+    int waiters; // threads asleep on count, or about to be
+    int spin;    // pause rounds before parking
+} fifo_tokens;
+
+/*
+Declare a struct of type entry, the start of every slot of the
+buffer. The item follows it, item_offset bytes from the start of the
+slot: by default a pointer to the hostname to resolve or filename,
+or with init_q_items() a record of any fixed size, copied into the
+slot as a whole. The fifo never looks at what an item holds.
 
 This type will be used to create a dynamically allocated
-array of entry structs.
+array of slots of slot_size bytes.
 */
 typedef struct
 {
-    char *address;
+    size_t seq; // ring position this slot is ready for (not FIFO_LOCKED)
 } entry;
 
 /*
 Declare a struct of type fifo that implements a FIFO
 queue. Members front and end allow for ordinal operations,
-and member buffer is simply an array of entry structs.
+and member buffer is simply an array of slots.
 
 Aldo declared are three semaphores used to solve the bounded
 buffer problem. See lecture 10C for pseudocode implementation.
 
-This implementation ensures that the array of entry structs
+This implementation ensures that the array of slots
 will occupy a contiguous space in memory, which will be
-dynamically allocated at run time.
+dynamically allocated at run time. Its capacity is a power of two,
+so a position is turned into an index with mask instead of %.
+
+The consumer side (head, front) and the producer side (tail, end)
+each start a cache line of their own, so producers and consumers
+don't invalidate each other's line on every operation.
 
 The semaphores ensure thread safety, eliminate race conditions,
 and avoid busy-waiting.
+
+Member closed is set by close_q() once producers are done. It is
+accompanied by one extra post of FULL, which wakes a consumer that
+finds the fifo empty; that consumer passes the token on so every
+blocked consumer sees the end of the stream in turn.
+
+In FIFO_LOCK_FREE and FIFO_ADAPTIVE modes M, front and end are
+unused. Members head and tail are ever increasing ring positions
+claimed with a CAS, and
+EMPTY and FULL only count free slots and entries. A sem_wait on a
+semaphore with a positive count is a single atomic operation in
+user space, so threads are only parked when the ring is actually
+full (EMPTY) or empty (FULL). FIFO_ADAPTIVE counts them in
+empty_tokens and full_tokens instead, each on a cache line of its own.
 */
 typedef struct
 {
-    entry *buffer;
-    int front, end;
+    char *buffer;
+    size_t capacity, mask;
+    size_t item_size;   // bytes copied in and out per item
+    size_t item_offset; // of the item within a slot, a multiple of its alignment
+    size_t slot_size;
     sem_t M, EMPTY, FULL;
-    bool used;
-} fifo;
+    bool closed;
+    fifo_mode mode;
 
-/*
-Used to pass multiple args to a start routine in pthread_create()
-*/
-typedef struct
-{
-    fifo *data_files;
-    fifo *shared_array;
-    FILE *req_log;
-    pthread_mutex_t *err_lock;
-    pthread_mutex_t *out_lock;
-} req_arg_struct;
+    size_t head __attribute__((aligned(CACHE_LINE_SIZE)));
+    int front;
 
-typedef struct
-{
-    fifo *shared_array;
-    FILE *res_log;
-    pthread_mutex_t *err_lock;
-    pthread_mutex_t *out_lock;
-} res_arg_struct;
-
-int init_q(fifo *q);
-int en_q(fifo *q, char *address);
-char *de_q(fifo *q);
+    size_t tail __attribute__((aligned(CACHE_LINE_SIZE)));
+    int end;
+
+    fifo_tokens empty_tokens __attribute__((aligned(CACHE_LINE_SIZE)));
+    fifo_tokens full_tokens __attribute__((aligned(CACHE_LINE_SIZE)));
+} fifo;
+
+int init_q(fifo *q, int capacity, fifo_mode mode);
+int init_q_items(fifo *q, int capacity, fifo_mode mode, size_t item_size, size_t item_align);
+int en_q(fifo *q, void *address);
+int en_q_n(fifo *q, void **items, int n);
+int timed_en_q(fifo *q, void *address, int wait_ms);
+int de_q(fifo *q, void **address);
+int de_q_n(fifo *q, void **out, int max);
+int try_de_q_n(fifo *q, void **out, int max);
+int timed_de_q_n(fifo *q, void **out, int max, int wait_ms);
+int en_q_items(fifo *q, const void *items, int n);
+int de_q_items(fifo *q, void *out, int max);
+int timed_de_q_items(fifo *q, void *out, int max, int wait_ms);
+void close_q(fifo *q);
+int q_size(fifo *q);
 int de_init_q(fifo *q);
 void print_q(fifo *q);
 
@@ -0,0 +1,816 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+Implementation of a fifo of hostnames shared by
+processes through a named shared memory segment.
+*/
+
+#include "shm_fifo.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SHM_MAGIC 0x6f666966736c6d68ULL // "hmlsfifo"
+#define WAIT_FOREVER -1
+
+/*
+Returns the size of a segment holding capacity slots.
+*/
+static size_t segment_size(size_t capacity)
+{
+    size_t ring = (sizeof(shm_header) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+
+    return ring + capacity * (sizeof(shm_slot) + SHM_NAME_SIZE);
+}
+
+/*
+Returns the name cell of a slot.
+*/
+static char *cell(shm_fifo *q, const shm_slot *slot)
+{
+    return (char *)q->h + slot->offset;
+}
+
+/*
+Returns true if process pid still runs.
+*/
+static bool alive(pid_t pid)
+{
+    return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+/*
+Marks the fifo as closed and posts the close token, as close_q()
+does. The caller must hold the flock.
+*/
+static void mark_closed(shm_header *h)
+{
+    if (!__atomic_exchange_n(&h->closed, true, __ATOMIC_ACQ_REL))
+    {
+        sem_post(&h->FULL);
+    }
+}
+
+/*
+Returns the number of attached processes of a role, counting every
+role if role is negative. The caller must hold the flock.
+*/
+static int attached(shm_header *h, int role)
+{
+    int n = 0;
+
+    for (int i = 0; i < SHM_MAX_PROCS; i++)
+    {
+        if (h->procs[i].pid != 0 && (role < 0 || (int)h->procs[i].role == role))
+        {
+            n++;
+        }
+    }
+
+    return n;
+}
+
+/*
+Detaches every process that has died without detaching, posting the
+tokens it held. The caller must hold the flock.
+*/
+static void detach_dead(shm_header *h)
+{
+    for (int i = 0; i < SHM_MAX_PROCS; i++)
+    {
+        shm_proc *p = &h->procs[i];
+        if (p->pid == 0 || alive(p->pid))
+        {
+            continue;
+        }
+
+        for (int t = __atomic_load_n(&p->empty_held, __ATOMIC_SEQ_CST); t > 0; t--)
+        {
+            sem_post(&h->EMPTY);
+        }
+        for (int t = __atomic_load_n(&p->full_held, __ATOMIC_SEQ_CST); t > 0; t--)
+        {
+            sem_post(&h->FULL);
+        }
+        p->pid = 0;
+    }
+}
+
+/*
+Detaches every process that has died without detaching, and closes
+the fifo once no producer is left. Called by processes that have
+waited SHM_POLL_MS in vain.
+*/
+static void reap(shm_fifo *q)
+{
+    shm_header *h = q->h;
+
+    flock(q->fd, LOCK_EX);
+    detach_dead(h);
+    if (h->had_producer && attached(h, SHM_PRODUCER) == 0)
+    {
+        mark_closed(h);
+    }
+    flock(q->fd, LOCK_UN);
+}
+
+/*
+Writes the header and the free slots of a new ring of capacity slots.
+The magic number goes last, a segment without it is incomplete.
+*/
+static void format(shm_header *h, size_t capacity)
+{
+    memset(h, 0, sizeof(shm_header));
+    h->capacity = capacity;
+    h->mask = capacity - 1;
+    h->ring_offset = (sizeof(shm_header) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+    sem_init(&h->EMPTY, 1, capacity); // shared between processes
+    sem_init(&h->FULL, 1, 0);
+
+    shm_slot *ring = (shm_slot *)((char *)h + h->ring_offset);
+    uint32_t names = h->ring_offset + capacity * sizeof(shm_slot);
+    for (size_t i = 0; i < capacity; i++)
+    {
+        ring[i].seq = i; // slot i is free for ring position i
+        ring[i].offset = names + i * SHM_NAME_SIZE;
+        ring[i].len = 0;
+    }
+
+    __atomic_store_n(&h->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+}
+
+/*
+Readies a segment left behind with hostnames in it and no process
+attached for a new pipeline. Slots a dead process left in flight are
+finished as repair() would, the tokens are counted anew from head and
+tail since the dead ones may have held some, and the fifo is opened
+again, so its consumers wait for the next producer. The caller must
+hold the flock.
+*/
+static void reopen(shm_header *h)
+{
+    shm_slot *ring = (shm_slot *)((char *)h + h->ring_offset);
+    size_t head = h->head;
+    size_t tail = h->tail;
+
+    for (size_t pos = head; pos < head + h->capacity; pos++)
+    {
+        shm_slot *slot = &ring[pos & h->mask];
+        if (pos >= tail)
+        {
+            slot->seq = pos; // free, or released by a consumer that died
+        }
+        else if (slot->seq != pos + 1)
+        {
+            slot->len = 0; // never written by a producer that died
+            slot->seq = pos + 1;
+        }
+    }
+
+    sem_init(&h->EMPTY, 1, h->capacity - (tail - head));
+    sem_init(&h->FULL, 1, tail - head); // without the close token
+    h->closed = false;
+    h->had_producer = false;
+}
+
+/*
+Expects four arguments:
+1. a pointer to a shm_fifo struct
+2. the name of the segment, e.g. "/hostnames", see shm_open(3)
+3. the number of slots of a new segment, rounded up to a power of
+   two. An existing segment keeps its own.
+4. SHM_PRODUCER or SHM_CONSUMER
+
+Creates the segment or attaches to the one there. A segment left
+behind drained with no process attached, or one whose creator died
+before finishing it, is formatted again. One left behind with
+hostnames in it keeps them for the next pipeline, see reopen().
+
+Returns 0 on success, -1 with errno set on failure
+*/
+int open_shm_fifo(shm_fifo *q, const char *name, int capacity, shm_role role)
+{
+    if (capacity < 1 || capacity > SHM_MAX_CAPACITY)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    size_t slots = 1;
+    while (slots < (size_t)capacity)
+    {
+        slots <<= 1;
+    }
+
+    q->h = MAP_FAILED;
+    q->proc = -1;
+    q->name = strdup(name);
+    q->fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (q->name == NULL || q->fd < 0)
+    {
+        goto fail;
+    }
+
+    // only one process sets up the segment or changes the list of processes at a time
+    flock(q->fd, LOCK_EX);
+
+    struct stat st;
+    if (fstat(q->fd, &st) != 0)
+    {
+        goto fail_locked;
+    }
+
+    if ((size_t)st.st_size >= sizeof(shm_header))
+    {
+        q->size = st.st_size;
+        q->h = mmap(NULL, q->size, PROT_READ | PROT_WRITE, MAP_SHARED, q->fd, 0);
+        if (q->h == MAP_FAILED)
+        {
+            goto fail_locked;
+        }
+
+        shm_header *h = q->h;
+        bool complete = __atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) == SHM_MAGIC && q->size == segment_size(h->capacity);
+        if (complete)
+        {
+            detach_dead(h);
+        }
+
+        if (complete && attached(h, -1) > 0)
+        {
+            goto attach;
+        }
+        if (complete && h->head != h->tail)
+        {
+            reopen(h);
+            goto attach;
+        }
+        if (!complete && attached(h, -1) > 0)
+        {
+            errno = EINVAL; // not a fifo of ours
+            goto fail_locked;
+        }
+
+        munmap(q->h, q->size);
+        q->h = MAP_FAILED;
+    }
+
+    q->size = segment_size(slots);
+    if (ftruncate(q->fd, 0) != 0 || ftruncate(q->fd, q->size) != 0)
+    {
+        goto fail_locked;
+    }
+    q->h = mmap(NULL, q->size, PROT_READ | PROT_WRITE, MAP_SHARED, q->fd, 0);
+    if (q->h == MAP_FAILED)
+    {
+        goto fail_locked;
+    }
+    format(q->h, slots);
+
+attach:
+    for (int i = 0; i < SHM_MAX_PROCS; i++)
+    {
+        if (q->h->procs[i].pid == 0)
+        {
+            q->h->procs[i].pid = getpid();
+            q->h->procs[i].role = role;
+            q->h->procs[i].claim = 0;
+            q->h->procs[i].empty_held = 0;
+            q->h->procs[i].full_held = 0;
+            q->proc = i;
+            break;
+        }
+    }
+    if (q->proc < 0)
+    {
+        errno = EBUSY;
+        goto fail_locked;
+    }
+    if (role == SHM_PRODUCER)
+    {
+        q->h->had_producer = true;
+    }
+
+    q->ring = (shm_slot *)((char *)q->h + q->h->ring_offset);
+    flock(q->fd, LOCK_UN);
+    return 0;
+
+fail_locked:
+    flock(q->fd, LOCK_UN);
+fail:
+    {
+        int saved = errno;
+        if (q->h != MAP_FAILED)
+        {
+            munmap(q->h, q->size);
+        }
+        if (q->fd >= 0)
+        {
+            close(q->fd);
+        }
+        free(q->name);
+        errno = saved;
+    }
+    return -1;
+}
+
+/*
+Waits until semaphore s has a token or wait_ms milliseconds have
+passed, forever if WAIT_FOREVER. Every SHM_POLL_MS of waiting the
+processes that died are reaped, which may close the fifo and so
+post the token a consumer waits for.
+
+Returns the number of tokens taken, up to max, 0 only if the wait
+timed out.
+*/
+static int take_tokens(shm_fifo *q, sem_t *s, int max, int wait_ms)
+{
+    int taken = 1;
+
+    while (sem_trywait(s) != 0)
+    {
+        if (wait_ms == 0) // just a try
+        {
+            return 0;
+        }
+
+        int step = wait_ms == WAIT_FOREVER || wait_ms > SHM_POLL_MS ? SHM_POLL_MS : wait_ms;
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until); // the clock sem_timedwait() measures against
+        until.tv_nsec += step * 1000000L;
+        if (until.tv_nsec >= 1000000000L)
+        {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+
+        int rc;
+        while ((rc = sem_timedwait(s, &until)) != 0 && errno == EINTR)
+        {
+        }
+        if (rc == 0)
+        {
+            break;
+        }
+
+        reap(q);
+        if (wait_ms != WAIT_FOREVER && (wait_ms -= step) <= 0)
+        {
+            return 0;
+        }
+    }
+
+    while (taken < max && sem_trywait(s) == 0)
+    {
+        taken++;
+    }
+
+    return taken;
+}
+
+/*
+Returns CLOCK_MONOTONIC in milliseconds.
+*/
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+Announces that this process is about to claim ring positions from
+pos on.
+*/
+static void set_claim(shm_fifo *q, size_t pos)
+{
+    __atomic_store_n(&q->h->procs[q->proc].claim, pos + 1, __ATOMIC_SEQ_CST);
+}
+
+/*
+Announces that this process holds no ring positions.
+*/
+static void clear_claim(shm_fifo *q)
+{
+    __atomic_store_n(&q->h->procs[q->proc].claim, 0, __ATOMIC_SEQ_CST);
+}
+
+/*
+Adds empty and full to the EMPTY and FULL tokens this process holds,
+see shm_proc.
+*/
+static void hold(shm_fifo *q, int empty, int full)
+{
+    shm_proc *p = &q->h->procs[q->proc];
+
+    __atomic_add_fetch(&p->empty_held, empty, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&p->full_held, full, __ATOMIC_SEQ_CST);
+}
+
+/*
+Returns true if a live process of role may hold ring position pos.
+A claim covers at most capacity positions. The caller must hold the
+flock.
+*/
+static bool claimed(shm_header *h, shm_role role, size_t pos)
+{
+    for (int i = 0; i < SHM_MAX_PROCS; i++)
+    {
+        size_t claim = __atomic_load_n(&h->procs[i].claim, __ATOMIC_SEQ_CST);
+        if (h->procs[i].pid != 0 && h->procs[i].role == role && claim != 0 && claim - 1 <= pos &&
+            pos - (claim - 1) < h->capacity && alive(h->procs[i].pid))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+Called by a process that has waited SHM_POLL_MS for the slot of ring
+position pos. If a process died between claiming the slot and
+publishing or releasing it, finishes its work: a producer's slot
+becomes an empty entry, a consumer's slot is released and the name
+in it is lost. The token owed for the slot was posted when the dead
+process was reaped.
+
+A slot is in flight when the tail (or head) has passed its position
+but its seq was not advanced. Claims are announced before the
+compare and swap on the tail (or head) and withdrawn after the seq
+stores, so a slot in flight that no live process claims is abandoned.
+*/
+static void repair(shm_fifo *q, size_t pos)
+{
+    shm_header *h = q->h;
+    shm_slot *slot = &q->ring[pos & h->mask];
+
+    flock(q->fd, LOCK_EX);
+    size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_SEQ_CST);
+    if (((seq - pos) & h->mask) == 0) // free for position seq, in flight if a producer has claimed it
+    {
+        if (__atomic_load_n(&h->tail, __ATOMIC_SEQ_CST) > seq && !claimed(h, SHM_PRODUCER, seq))
+        {
+            slot->len = 0;
+            __atomic_compare_exchange_n(&slot->seq, &seq, seq + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+        }
+    }
+    else if (__atomic_load_n(&h->head, __ATOMIC_SEQ_CST) > seq - 1 && !claimed(h, SHM_CONSUMER, seq - 1))
+    {
+        // holds the entry of position seq - 1, claimed by a consumer that is gone
+        size_t entry = seq;
+        __atomic_compare_exchange_n(&slot->seq, &entry, seq - 1 + h->capacity, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+    }
+    flock(q->fd, LOCK_UN);
+}
+
+/*
+Claims up to n slots at the tail of the ring and copies the names
+into their cells, like ring_push_n() in shared_array.c.
+
+Returns the number of names stored, 0 if the slot at the tail has
+not been released by a consumer yet.
+*/
+static int ring_push_n(shm_fifo *q, const char **names, const int *lens, int n)
+{
+    shm_header *h = q->h;
+    size_t pos = __atomic_load_n(&h->tail, __ATOMIC_RELAXED);
+
+    for (;;)
+    {
+        int ready = 0;
+        while (ready < n && __atomic_load_n(&q->ring[(pos + ready) & h->mask].seq, __ATOMIC_ACQUIRE) == pos + ready)
+        {
+            ready++;
+        }
+
+        if (ready == 0)
+        {
+            intptr_t dif = (intptr_t)__atomic_load_n(&q->ring[pos & h->mask].seq, __ATOMIC_ACQUIRE) - (intptr_t)pos;
+            if (dif < 0)
+            {
+                clear_claim(q);
+                return 0;
+            }
+
+            pos = __atomic_load_n(&h->tail, __ATOMIC_RELAXED); // another producer took this position
+            continue;
+        }
+
+        set_claim(q, pos);
+        if (__atomic_compare_exchange_n(&h->tail, &pos, pos + ready, true, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        {
+            hold(q, -ready, ready); // the positions are ours, their entries owe a FULL token
+            for (int i = 0; i < ready; i++)
+            {
+                shm_slot *slot = &q->ring[(pos + i) & h->mask];
+                int len = lens[i] < SHM_NAME_SIZE ? lens[i] : SHM_NAME_SIZE - 1; // never write past the cell
+
+                memcpy(cell(q, slot), names[i], len);
+                slot->len = len;
+                __atomic_store_n(&slot->seq, pos + i + 1, __ATOMIC_RELEASE);
+            }
+            clear_claim(q);
+            return ready;
+        }
+    }
+}
+
+/*
+Claims up to max slots at the head of the ring and copies their
+names to buf, one per line, like ring_pop_n() in shared_array.c.
+buf must hold max * SHM_NAME_SIZE bytes.
+
+Returns the number of names removed, 0 if the slot at the head has
+not been published by a producer yet. *used grows by the bytes
+written, empty entries are removed without writing a line.
+*/
+static int ring_pop_lines(shm_fifo *q, char *buf, size_t *used, int max)
+{
+    shm_header *h = q->h;
+    size_t pos = __atomic_load_n(&h->head, __ATOMIC_RELAXED);
+
+    for (;;)
+    {
+        int ready = 0;
+        while (ready < max && __atomic_load_n(&q->ring[(pos + ready) & h->mask].seq, __ATOMIC_ACQUIRE) == pos + ready + 1)
+        {
+            ready++;
+        }
+
+        if (ready == 0)
+        {
+            intptr_t dif = (intptr_t)__atomic_load_n(&q->ring[pos & h->mask].seq, __ATOMIC_ACQUIRE) - (intptr_t)(pos + 1);
+            if (dif < 0)
+            {
+                clear_claim(q);
+                return 0;
+            }
+
+            pos = __atomic_load_n(&h->head, __ATOMIC_RELAXED); // another consumer took this position
+            continue;
+        }
+
+        set_claim(q, pos);
+        if (__atomic_compare_exchange_n(&h->head, &pos, pos + ready, true, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        {
+            hold(q, ready, -ready); // the positions are ours, their slots owe an EMPTY token
+            for (int i = 0; i < ready; i++)
+            {
+                shm_slot *slot = &q->ring[(pos + i) & h->mask];
+
+                if (slot->len > 0) // empty entries stand for names a dead producer never wrote
+                {
+                    memcpy(buf + *used, cell(q, slot), slot->len);
+                    *used += slot->len;
+                    buf[(*used)++] = '\n';
+                }
+                __atomic_store_n(&slot->seq, pos + i + h->capacity, __ATOMIC_RELEASE);
+            }
+            clear_claim(q);
+            return ready;
+        }
+    }
+}
+
+/*
+Expects four arguments:
+1. a pointer to a shm_fifo struct attached as SHM_PRODUCER
+2. an array of n hostnames, not necessarily NUL terminated
+3. their lengths, each less than SHM_NAME_SIZE
+4. the number of hostnames
+
+Copies the hostnames into the ring, in order, blocking while it is
+full.
+
+Returns 0 once all n are enqueued, or FIFO_CLOSED if the fifo has
+been closed.
+*/
+int shm_put_n(shm_fifo *q, const char **names, const int *lens, int n)
+{
+    shm_header *h = q->h;
+
+    if (__atomic_load_n(&h->closed, __ATOMIC_ACQUIRE))
+    {
+        return FIFO_CLOSED;
+    }
+
+    int done = 0;
+    while (done < n)
+    {
+        int room = take_tokens(q, &h->EMPTY, n - done, WAIT_FOREVER); // waits only if the ring is full
+        int pushed = 0;
+        hold(q, room, 0);
+        uint64_t since = 0; // when the slot at the tail was first found in use, 0 while not waiting
+
+        // holding EMPTY tokens guarantees slots are being released,
+        // a slow consumer may just not have released them yet, or a dead one never will
+        while (pushed < room)
+        {
+            int k = ring_push_n(q, names + done + pushed, lens + done + pushed, room - pushed);
+            if (k == 0)
+            {
+                uint64_t now = now_ms();
+                if (since == 0)
+                {
+                    since = now;
+                }
+                else if (now - since >= SHM_POLL_MS)
+                {
+                    reap(q);
+                    repair(q, __atomic_load_n(&h->tail, __ATOMIC_RELAXED));
+                    since = now;
+                }
+                sched_yield();
+            }
+            else
+            {
+                since = 0;
+            }
+            pushed += k;
+        }
+
+        hold(q, 0, -room);
+        for (int i = 0; i < room; i++)
+        {
+            sem_post(&h->FULL);
+        }
+        done += room;
+    }
+
+    return 0;
+}
+
+/*
+Expects four arguments:
+1. a pointer to a shm_fifo struct attached as SHM_CONSUMER
+2. a buffer that receives hostnames, one per line
+3. its size, at least SHM_NAME_SIZE
+4. how long to wait for a hostname in milliseconds, -1 for ever
+
+Takes as many hostnames as fit in the buffer and are available,
+after waiting for the first.
+
+Returns the number of bytes written, FIFO_AGAIN if the fifo stayed
+empty for wait_ms or only held names a dead producer never wrote, or
+FIFO_CLOSED once it is closed and drained.
+*/
+int shm_take_lines(shm_fifo *q, char *buf, size_t size, int wait_ms)
+{
+    shm_header *h = q->h;
+    int max = size / SHM_NAME_SIZE;
+    int tokens;
+    bool borrowed = false;
+    int got = 0;
+    size_t used = 0;
+    uint64_t since = 0; // when the slot at the head was first found unpublished, 0 while not waiting
+
+    // a producer that died before posting FULL leaves names without tokens, once
+    // the fifo is closed they are taken without one
+    for (;;)
+    {
+        int step = wait_ms == WAIT_FOREVER || wait_ms > SHM_POLL_MS ? SHM_POLL_MS : wait_ms;
+        tokens = take_tokens(q, &h->FULL, max, step); // waits only if the ring is empty
+        if (tokens > 0)
+        {
+            hold(q, 0, tokens);
+            break;
+        }
+        if (__atomic_load_n(&h->closed, __ATOMIC_ACQUIRE))
+        {
+            if (__atomic_load_n(&h->head, __ATOMIC_ACQUIRE) == __atomic_load_n(&h->tail, __ATOMIC_ACQUIRE))
+            {
+                return FIFO_CLOSED;
+            }
+            tokens = 1;
+            borrowed = true;
+            hold(q, 0, 1); // posted if this process dies, which a closed fifo tolerates
+            break;
+        }
+        if (wait_ms != WAIT_FOREVER && (wait_ms -= step) <= 0)
+        {
+            return FIFO_AGAIN;
+        }
+    }
+
+    // as in take_entries() of shared_array.c
+    while (got < tokens)
+    {
+        int k = ring_pop_lines(q, buf, &used, tokens - got);
+
+        if (k == 0)
+        {
+            if (got > 0)
+            {
+                break;
+            }
+            if (__atomic_load_n(&h->closed, __ATOMIC_ACQUIRE) &&
+                __atomic_load_n(&h->head, __ATOMIC_ACQUIRE) == __atomic_load_n(&h->tail, __ATOMIC_ACQUIRE))
+            {
+                break; // drained, what is left of the tokens is the close token
+            }
+
+            uint64_t now = now_ms();
+            if (since == 0)
+            {
+                since = now;
+            }
+            else if (now - since >= SHM_POLL_MS)
+            {
+                reap(q);
+                repair(q, __atomic_load_n(&h->head, __ATOMIC_RELAXED));
+                since = now;
+            }
+            sched_yield();
+        }
+        else
+        {
+            since = 0;
+        }
+
+        got += k;
+    }
+
+    hold(q, -got, got - tokens);
+    if (borrowed)
+    {
+        tokens = got; // no FULL token was taken, none is passed on
+    }
+    for (int i = got; i < tokens; i++)
+    {
+        sem_post(&h->FULL); // passes the close token on
+    }
+    for (int i = 0; i < got; i++)
+    {
+        sem_post(&h->EMPTY);
+    }
+
+    if (got == 0)
+    {
+        return FIFO_CLOSED;
+    }
+    return used > 0 ? (int)used : FIFO_AGAIN;
+}
+
+/*
+Detaches this process, and unless another producer is still
+attached, closes the fifo. Intended to be called by a producer once
+it has returned from its last shm_put_n().
+*/
+void close_shm_fifo(shm_fifo *q)
+{
+    flock(q->fd, LOCK_EX);
+    if (q->proc >= 0)
+    {
+        q->h->procs[q->proc].pid = 0;
+        q->proc = -1;
+    }
+    if (attached(q->h, SHM_PRODUCER) == 0)
+    {
+        mark_closed(q->h);
+    }
+    flock(q->fd, LOCK_UN);
+}
+
+/*
+Expects as sole argument a pointer to a shm_fifo struct
+
+Detaches this process and unmaps the segment. The last process to
+leave a drained fifo removes the segment, hostnames still waiting in
+it are kept for the next consumer.
+
+Returns 0 on success
+*/
+int de_init_shm_fifo(shm_fifo *q)
+{
+    shm_header *h = q->h;
+
+    flock(q->fd, LOCK_EX);
+    if (q->proc >= 0)
+    {
+        h->procs[q->proc].pid = 0;
+        q->proc = -1;
+    }
+    if (attached(h, -1) == 0 && h->head == h->tail)
+    {
+        shm_unlink(q->name);
+    }
+    flock(q->fd, LOCK_UN);
+
+    munmap(q->h, q->size);
+    close(q->fd);
+    free(q->name);
+
+    return 0;
+}
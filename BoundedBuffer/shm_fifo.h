@@ -0,0 +1,122 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+A header file used to implement a fifo of hostnames
+shared by processes through a named shared memory segment.
+*/
+
+#ifndef SHM_FIFO_H
+#define SHM_FIFO_H
+
+#include "shared_array.h"
+#include <stdint.h>
+#include <sys/types.h>
+
+#define SHM_NAME_SIZE 256        // bytes of a slot's name cell, MAX_NAME_LENGTH of multi-lookup.h
+#define SHM_MAX_CAPACITY (1 << 20)
+#define SHM_MAX_PROCS 64         // processes attached at once
+#define SHM_POLL_MS 100          // how often a waiting process looks for peers that died
+
+typedef enum
+{
+    SHM_PRODUCER,
+    SHM_CONSUMER
+} shm_role;
+
+/*
+Declare a struct of type shm_slot, one position of the ring.
+
+As in a FIFO_LOCK_FREE fifo the slot is free for ring position pos
+when seq equals pos and holds an entry when seq equals pos + 1. The
+name is stored in the slot's own cell, offset bytes from the start
+of the segment, since every process maps the segment at a different
+address and a pointer written by one would be garbage to the others.
+*/
+typedef struct
+{
+    size_t seq;
+    uint32_t offset;
+    uint32_t len;
+} shm_slot;
+
+/*
+Declare a struct of type shm_proc, a process attached to the fifo.
+pid is 0 while the entry is unused.
+
+claim is set just before the process tries to claim ring positions
+and cleared once it has published or released them, so a slot left
+in flight that no live process claims belongs to a dead one (see
+repair() in shm_fifo.c).
+
+empty_held and full_held count the EMPTY and FULL tokens the process
+has taken or owes for ring positions it has claimed, but not posted
+yet. Once it has died reap() posts them, so the ring keeps its size.
+*/
+typedef struct
+{
+    pid_t pid;
+    shm_role role;
+    size_t claim; // first ring position claimed, plus one, 0 while none
+    int empty_held, full_held;
+} shm_proc;
+
+/*
+Declare a struct of type shm_header, found at the start of the
+segment and followed by the ring and the name cells.
+
+EMPTY and FULL are process-shared semaphores with the same meaning
+as in a fifo, including the close token. The fifo is closed when its
+last producer detaches, so every producer of a pipeline should attach
+before the first one is done. It is also closed when a waiting
+process finds that every producer that ever attached has died, so
+consumers never wait for a parser that is gone. A segment left with
+hostnames in it by a pipeline whose processes are all gone is opened
+again for the next one, whose consumers wait for its first producer.
+
+A process that dies in the middle of claiming slots leaves them in
+flight, and the processes after it would wait for them forever. Once
+a slot has kept a process waiting for SHM_POLL_MS without a live
+owner, the waiting process repairs it. A producer's slot becomes an
+empty entry, which consumers skip, and a consumer's slot is released
+with its name lost. The tokens the dead process held are posted when
+it is reaped. The producers of a fifo whose consumers all died
+block until another consumer attaches, rather than failing like the
+writer of a pipe whose reader is gone.
+*/
+typedef struct
+{
+    uint64_t magic;
+    size_t capacity, mask;
+    uint32_t ring_offset;
+    sem_t EMPTY, FULL;
+    bool closed;
+    bool had_producer;
+    shm_proc procs[SHM_MAX_PROCS];
+
+    size_t head __attribute__((aligned(CACHE_LINE_SIZE)));
+    size_t tail __attribute__((aligned(CACHE_LINE_SIZE)));
+} shm_header;
+
+/*
+Declare a struct of type shm_fifo, one process's handle on the
+segment.
+*/
+typedef struct
+{
+    shm_header *h;
+    shm_slot *ring;
+    size_t size; // bytes mapped
+    char *name;  // of the segment, for shm_unlink()
+    int fd;      // flock()ed around changes of h->procs
+    int proc;    // index of this process in h->procs, -1 once detached
+} shm_fifo;
+
+int open_shm_fifo(shm_fifo *q, const char *name, int capacity, shm_role role);
+int shm_put_n(shm_fifo *q, const char **names, const int *lens, int n);
+int shm_take_lines(shm_fifo *q, char *buf, size_t size, int wait_ms);
+void close_shm_fifo(shm_fifo *q);
+int de_init_shm_fifo(shm_fifo *q);
+
+#endif
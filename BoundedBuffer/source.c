@@ -0,0 +1,300 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+Implementation of the hostname sources read by
+requesters when running as a daemon.
+*/
+
+#define _GNU_SOURCE // pipe2(), accept4()
+#include "source.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/*
+Opens a listening unix socket at path, replacing a stale socket
+left behind by an earlier run.
+
+Returns the descriptor, or -1 with errno set.
+*/
+static int listen_unix(const char *path)
+{
+    struct sockaddr_un addr;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOURCE_BACKLOG) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/*
+Waits until fd is readable or the source is stopped.
+
+Returns true if fd is readable, false once stopped.
+*/
+static bool wait_readable(input_source *s, int fd)
+{
+    struct pollfd fds[2] = {{.fd = fd, .events = POLLIN}, {.fd = s->stop[0], .events = POLLIN}};
+
+    for (;;)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+
+        if (fds[1].revents != 0)
+        {
+            return false;
+        }
+        if (fds[0].revents != 0)
+        {
+            return true;
+        }
+    }
+}
+
+/*
+Returns true once the source has been stopped, without waiting.
+*/
+static bool stopped(input_source *s)
+{
+    struct pollfd fd = {.fd = s->stop[0], .events = POLLIN};
+
+    return poll(&fd, 1, 0) > 0;
+}
+
+/*
+Expects two arguments:
+1. a pointer to an input_source struct
+2. where to read from: "-" for stdin, "unix:<path>" for a unix
+   socket to listen on, "shm:<name>" for a shared memory fifo (see
+   shm_fifo.h), otherwise the path of a named pipe
+
+A named pipe is opened for reading and writing, so it never reports
+end of file when a writer disconnects and the daemon keeps reading
+whatever the next writer sends.
+
+Returns 0 on success, -1 with errno set on failure
+*/
+int open_source(input_source *s, const char *spec)
+{
+    s->taken = false;
+    s->path = NULL;
+
+    if (pipe2(s->stop, O_CLOEXEC | O_NONBLOCK) != 0)
+    {
+        return -1;
+    }
+
+    if (strcmp(spec, "-") == 0)
+    {
+        s->kind = SOURCE_STDIN;
+        s->fd = STDIN_FILENO;
+        return 0;
+    }
+
+    if (strncmp(spec, "unix:", 5) == 0)
+    {
+        s->kind = SOURCE_SOCKET;
+        s->path = strdup(spec + 5);
+        s->fd = s->path != NULL ? listen_unix(s->path) : -1;
+    }
+    else if (strncmp(spec, "shm:", 4) == 0)
+    {
+        s->kind = SOURCE_SHM;
+        s->fd = open_shm_fifo(&s->shm, spec + 4, BUFFER_SIZE, SHM_CONSUMER) == 0 ? s->shm.fd : -1;
+    }
+    else
+    {
+        struct stat st;
+
+        s->kind = SOURCE_FIFO;
+        s->path = strdup(spec);
+        if (stat(spec, &st) == 0 && !S_ISFIFO(st.st_mode))
+        {
+            errno = EINVAL;
+            s->fd = -1;
+        }
+        else
+        {
+            s->fd = open(spec, O_RDWR | O_CLOEXEC);
+        }
+    }
+
+    if (s->fd < 0)
+    {
+        int saved = errno;
+        close(s->stop[0]);
+        close(s->stop[1]);
+        free(s->path);
+        errno = saved;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+Hands a requester the next stream to read. Safe to call from many
+threads at once.
+
+Stdin, a named pipe and a shared memory fifo are a single stream,
+handed to the first caller only. A socket hands out a connection per call, waiting for
+the next client as long as the source runs.
+
+Returns the descriptor of the stream, or -1 once the source has no
+more streams or has been stopped.
+*/
+int next_stream(input_source *s)
+{
+    if (s->kind != SOURCE_SOCKET)
+    {
+        if (__atomic_exchange_n(&s->taken, true, __ATOMIC_ACQ_REL))
+        {
+            return -1;
+        }
+        return s->fd;
+    }
+
+    while (wait_readable(s, s->fd))
+    {
+        // several requesters may wake for one client, those that lose the race wait again
+        int conn = accept4(s->fd, NULL, NULL, SOCK_CLOEXEC);
+        if (conn >= 0)
+        {
+            return conn;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED)
+        {
+            return -1;
+        }
+    }
+
+    return -1;
+}
+
+/*
+Reads from a stream like read(), but gives up once the source is
+stopped.
+
+A shared memory fifo is read as whole lines, one per hostname, and
+ends once every producer process has closed it or died.
+
+Returns the number of bytes read, 0 at end of stream or once
+stopped, or -1 with errno set on failure.
+*/
+ssize_t read_stream(input_source *s, int fd, char *buf, size_t size)
+{
+    while (s->kind == SOURCE_SHM && !stopped(s))
+    {
+        int n = shm_take_lines(&s->shm, buf, size, SHM_POLL_MS);
+        if (n != FIFO_AGAIN)
+        {
+            return n > 0 ? n : 0;
+        }
+    }
+    if (s->kind == SOURCE_SHM)
+    {
+        return 0;
+    }
+
+    for (;;)
+    {
+        if (!wait_readable(s, fd))
+        {
+            return 0;
+        }
+
+        ssize_t n = read(fd, buf, size);
+        if (n >= 0 || (errno != EINTR && errno != EAGAIN))
+        {
+            return n;
+        }
+    }
+}
+
+/*
+Releases a stream obtained from next_stream(). Connections are
+closed, stdin and a named pipe stay open until close_source().
+*/
+void end_stream(input_source *s, int fd)
+{
+    if (s->kind == SOURCE_SOCKET)
+    {
+        close(fd);
+    }
+}
+
+/*
+Ends all waiting in next_stream() and read_stream(), now and later.
+Only calls write(), so it is safe to call from a signal handler.
+*/
+void stop_source(input_source *s)
+{
+    int saved = errno;
+    ssize_t ignored = write(s->stop[1], "", 1);
+    (void)ignored;
+    errno = saved;
+}
+
+/*
+Expects as sole argument a pointer to an input_source struct
+
+Must only be called once no thread uses the source. Closes it and
+removes a socket from the file system.
+
+Returns 0 on success
+*/
+int close_source(input_source *s)
+{
+    if (s->kind == SOURCE_SHM)
+    {
+        de_init_shm_fifo(&s->shm);
+    }
+    else if (s->kind != SOURCE_STDIN)
+    {
+        close(s->fd);
+    }
+    if (s->kind == SOURCE_SOCKET)
+    {
+        unlink(s->path);
+    }
+    free(s->path);
+    close(s->stop[0]);
+    close(s->stop[1]);
+
+    return 0;
+}
@@ -0,0 +1,53 @@
+/*
+AUTHOR JOHN HARRINGTON
+
+PROGRAMMING ASSIGNMENT 3 PART A
+
+A header file used to implement the hostname sources
+read by requesters when running as a daemon.
+*/
+
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include "shm_fifo.h"
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define SOURCE_BACKLOG 64 // pending connections on a unix socket source
+
+typedef enum
+{
+    SOURCE_STDIN,  // read until end of file
+    SOURCE_FIFO,   // named pipe, writers may come and go until stopped
+    SOURCE_SOCKET, // listening unix socket, every connection is a stream
+    SOURCE_SHM     // shared memory fifo filled by other processes, read until closed
+} source_kind;
+
+/*
+Declare a struct of type input_source, where a daemon reads hostnames
+from, one per line.
+
+A source hands out streams: the one descriptor of stdin, a named
+pipe or a shared memory fifo, or each accepted connection of a
+socket. Reads wait on the stream and on the read end of stop, so a
+signal handler can end every blocked read by calling stop_source().
+*/
+typedef struct
+{
+    source_kind kind;
+    char *path;    // of the named pipe or socket
+    int fd;        // stdin, the named pipe or the listening socket
+    int stop[2];   // pipe made readable by stop_source()
+    bool taken;    // the single stream of stdin, a named pipe or shm has been handed out
+    shm_fifo shm;  // SOURCE_SHM, attached as a consumer
+} input_source;
+
+int open_source(input_source *s, const char *spec);
+int next_stream(input_source *s);
+ssize_t read_stream(input_source *s, int fd, char *buf, size_t size);
+void end_stream(input_source *s, int fd);
+void stop_source(input_source *s);
+int close_source(input_source *s);
+
+#endif
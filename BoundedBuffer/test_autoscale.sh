@@ -0,0 +1,45 @@
+#!/bin/sh
+#
+# AUTHOR JOHN HARRINGTON
+#
+# PROGRAMMING ASSIGNMENT 3 PART A
+#
+# Checks that an autoscaled resolver pool grows to its maximum when
+# the resolvers cannot keep up. With fast lookups the hostname queue
+# stays full while its backlog estimate stays below SCALE_TARGET_MS,
+# so only the saturation trigger of scale_resolvers() can grow the
+# pool that far.
+#
+# Usage: ./test_autoscale.sh
+
+set -e
+
+NAMES=${NAMES:-20000}
+MIN=2
+MAX=6
+
+cd "$(dirname "$0")"
+make -s multi-lookup gen_names
+
+DATA=$(mktemp -d)
+trap 'rm -rf "$DATA"' EXIT
+
+./gen_names -n "$NAMES" -f 1 -d 0 -o "$DATA/names" > /dev/null
+out=$(./multi-lookup -b sim:mean=1 3 "$MIN:$MAX" "$DATA/req.txt" "$DATA/res.txt" "$DATA/names1.txt")
+
+peak=$(echo "$out" | sed -n 's/^resolver pool grew to \([0-9]*\) of.*/\1/p')
+if [ -z "$peak" ]; then
+    echo "FAIL: multi-lookup did not report the resolver pool" >&2
+    exit 1
+fi
+if [ "$peak" -lt "$MAX" ]; then
+    echo "FAIL: the saturated pool only grew to $peak of $MAX resolvers" >&2
+    exit 1
+fi
+if [ "$(wc -l < "$DATA/res.txt")" -ne "$NAMES" ]; then
+    echo "FAIL: $(wc -l < "$DATA/res.txt") of $NAMES hostnames were resolved" >&2
+    exit 1
+fi
+
+echo "PASS: the saturated pool grew from $MIN to $peak resolvers"
+echo "$out" | tail -n 1